@@ -1,8 +1,12 @@
 #include <CSVReweighter.hpp>
 
-#include <TFile.h>
+#include <CSVTables.hpp>
+
+#include <TH1.h>
 
 #include <cstdlib>
+#include <cmath>
+#include <memory>
 #include <string>
 #include <stdexcept>
 #include <sstream>
@@ -15,255 +19,334 @@ using namespace std;
 unsigned const CSVReweighter::nPtBinsHF;
 unsigned const CSVReweighter::nPtBinsLF;
 unsigned const CSVReweighter::nEtaBinsLF;
+unsigned const CSVReweighter::nFlavourClasses;
+unsigned const CSVReweighter::systStride;
 
 
 CSVReweighter::CSVReweighter()
 {
-    // Find the installation path of the package
-    char const *installPathPointer = getenv("CMS_DAS_TTbar_INSTALL");
+    // Histograms embedded at build time are looked up by names of the data files and their own
+    //names. The number of histograms is small, and a linear search is fast enough
+    auto readEmbedded = [this](string const &fileName, string const &name) -> unsigned
+    {
+        for (auto const &h: csvEmbeddedHistograms)
+            if (fileName == h.fileName and name == h.name)
+                return AddRow(name, h.nBins, h.xMin, h.xMax, h.content);
+        
+        throw runtime_error(string("Cannot find histogram \"") + name + "\" among the ones " +
+         "embedded from data file \"" + fileName + "\".");
+    };
     
-    if (not installPathPointer)
-        throw runtime_error("Environmental variable \"CMS_DAS_TTbar_INSTALL\" is not defined.");
+    BuildTable([&readEmbedded](string const &name){return readEmbedded("csv_rwt_hf.root", name);},
+     [&readEmbedded](string const &name){return readEmbedded("csv_rwt_lf.root", name);});
+}
+
+
+CSVReweighter::CSVReweighter(string const &hfFileName, string const &lfFileName)
+{
+    // Open data files that contain histograms for CSV reweighting
+    unique_ptr<TFile> dataFileHF(TFile::Open(hfFileName.c_str()));
+    unique_ptr<TFile> dataFileLF(TFile::Open(lfFileName.c_str()));
     
-    string installPath(installPathPointer);
+    if (not dataFileHF or dataFileHF->IsZombie())
+        throw runtime_error(string("Data file \"") + hfFileName +
+         "\" does not exist or is corrupted.");
     
-    if (installPath.length() > 0 and installPath[installPath.length() - 1] != '/')
-        installPath += '/';
+    if (not dataFileLF or dataFileLF->IsZombie())
+        throw runtime_error(string("Data file \"") + lfFileName +
+         "\" does not exist or is corrupted.");
     
-    string const dataPath(installPath + "Reader/data/");
     
+    // Read the histograms
+    BuildTable([this, &dataFileHF](string const &name){return ReadHistogram(*dataFileHF, name);},
+     [this, &dataFileLF](string const &name){return ReadHistogram(*dataFileLF, name);});
+}
+
+
+shared_ptr<CSVReweighter const> CSVReweighter::GetDefault()
+{
+    // Initialisation of a local static variable is thread-safe
+    static shared_ptr<CSVReweighter const> const instance(new CSVReweighter);
+    return instance;
+}
+
+
+double CSVReweighter::CalculateJetWeight(Jet const &jet,
+ SystType systType, SystDirection systDirection) const
+{
+    return CalculateJetWeight(jet.Pt(), jet.Eta(), jet.BTag(), jet.Flavour(), systType,
+     systDirection);
+}
+
+
+double CSVReweighter::CalculateJetWeight(double pt, double eta, double csv, int flavour,
+ SystType systType, SystDirection systDirection) const
+{
+    unsigned row, csvBin;
     
-    // Open data files that contain histograms for CSV reweighting
-    unique_ptr<TFile> dataFileHF(TFile::Open((dataPath + "csv_rwt_hf.root").c_str()));
-    unique_ptr<TFile> dataFileLF(TFile::Open((dataPath + "csv_rwt_lf.root").c_str()));
+    // If the jet is out of the supported range, return a unit weight
+    if (not FindJetBins(pt, eta, csv, flavour, row, csvBin))
+        return 1.;
     
-    if (not dataFileHF or dataFileHF->IsZombie())
-        throw runtime_error(string("Data file \"") + dataPath +
-         "csv_rwt_hf.root\" does not exist or is corrupted.");
     
-    if (not dataFileLF or dataFileLF->IsZombie())
-        throw runtime_error(string("Data file \"") + dataPath +
-         "csv_rwt_lf.root\" does not exist or is corrupted.");
+    // Look up the weight. Mismatched variations and the pt range for light-flavour jets, which
+    //is narrower than for heavy flavours, have been resolved when the table was filled
+    row += GetSystIndex({systType, systDirection}) * systStride;
+    return weights[rowOffsets[row] + csvBin];
+}
+
+
+double CSVReweighter::CalculateJetWeight(Jet const &jet) const
+{
+    return CalculateJetWeight(jet, SystType::Nominal, SystDirection::Up);
+}
+
+
+void CSVReweighter::CalculateEventWeights(JetCollection const &jets,
+ vector<double> &eventWeights) const
+{
+    unsigned const nVariations = GetAllSystVariations().size();
+    eventWeights.assign(nVariations, 1.);
     
+    float const *pt = jets.PtArray();
+    float const *eta = jets.EtaArray();
+    float const *bTag = jets.BTagArray();
+    int const *flavour = jets.FlavourArray();
     
-    // Read histograms for heavy flavours
-    for (unsigned iPt = 0; iPt < nPtBinsHF; ++iPt)
+    for (unsigned i = 0; i < jets.size(); ++i)
     {
-        ostringstream nameFragment;
-        nameFragment << "csv_ratio_Pt" << iPt << "_Eta0_final";
+        unsigned row, csvBin;
+        
+        if (not FindJetBins(pt[i], eta[i], bTag[i], flavour[i], row, csvBin))
+            continue;
         
-        weightsBottom[EncodeSyst(SystType::Nominal, SystDirection::Up)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get(nameFragment.str().c_str())));
-        weightsBottom[EncodeSyst(SystType::JEC, SystDirection::Up)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((nameFragment.str() + "_JESUp").c_str())));
-        weightsBottom[EncodeSyst(SystType::JEC, SystDirection::Down)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((nameFragment.str() + "_JESDown").c_str())));
-        weightsBottom[EncodeSyst(SystType::BTagPurityHF, SystDirection::Up)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((nameFragment.str() + "_LFUp").c_str())));
-        weightsBottom[EncodeSyst(SystType::BTagPurityHF, SystDirection::Down)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((nameFragment.str() + "_LFDown").c_str())));
-        weightsBottom[EncodeSyst(SystType::BTagStatHF1, SystDirection::Up)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((nameFragment.str() + "_Stats1Up").c_str())));
-        weightsBottom[EncodeSyst(SystType::BTagStatHF1, SystDirection::Down)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((nameFragment.str() + "_Stats1Down").c_str())));
-        weightsBottom[EncodeSyst(SystType::BTagStatHF2, SystDirection::Up)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((nameFragment.str() + "_Stats2Up").c_str())));
-        weightsBottom[EncodeSyst(SystType::BTagStatHF2, SystDirection::Down)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((nameFragment.str() + "_Stats2Down").c_str())));
         
-        weightsCharm[EncodeSyst(SystType::Nominal, SystDirection::Up)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((string("c_") + nameFragment.str()).c_str())));
-        weightsCharm[EncodeSyst(SystType::BTagCharmUnc1, SystDirection::Up)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((string("c_") + nameFragment.str() + "_cErr1Up").c_str())));
-        weightsCharm[EncodeSyst(SystType::BTagCharmUnc1, SystDirection::Down)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((string("c_") + nameFragment.str() + "_cErr1Down").c_str())));
-        weightsCharm[EncodeSyst(SystType::BTagCharmUnc2, SystDirection::Up)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((string("c_") + nameFragment.str() + "_cErr2Up").c_str())));
-        weightsCharm[EncodeSyst(SystType::BTagCharmUnc2, SystDirection::Down)][iPt].reset(
-         dynamic_cast<TH1D *>(dataFileHF->Get((string("c_") + nameFragment.str() + "_cErr2Down").c_str())));
+        // The bins are the same for all variations, only the slice of the table changes
+        for (unsigned iSyst = 0; iSyst < nVariations; ++iSyst, row += systStride)
+        {
+            double const w = weights[rowOffsets[row] + csvBin];
+            
+            if (w != 0.)
+                eventWeights[iSyst] *= w;
+        }
     }
+}
+
+
+void CSVReweighter::CalculateJetWeights(JetCollection const &jets, vector<double> &jetWeights)
+ const
+{
+    unsigned const nVariations = GetAllSystVariations().size();
+    jetWeights.assign(jets.size() * nVariations, 1.);
     
+    float const *pt = jets.PtArray();
+    float const *eta = jets.EtaArray();
+    float const *bTag = jets.BTagArray();
+    int const *flavour = jets.FlavourArray();
     
-    // Make sure all histograms for heavy flavours have been read
-    for (auto const &wp: weightsBottom)
-        for (unsigned iPt = 0; iPt < nPtBinsHF; ++iPt)
-            if (not wp.second[iPt])
-            {
-                ostringstream ost;
-                ost << "Cannot find histogram for b quarks, systematical variation #" <<
-                 unsigned(wp.first) << ", pt bin #" << iPt << ".";
-                 
-                throw runtime_error(ost.str());
-            }
+    for (unsigned i = 0; i < jets.size(); ++i)
+    {
+        unsigned row, csvBin;
+        
+        if (not FindJetBins(pt[i], eta[i], bTag[i], flavour[i], row, csvBin))
+            continue;
+        
+        double *dst = jetWeights.data() + i * nVariations;
+        
+        for (unsigned iSyst = 0; iSyst < nVariations; ++iSyst, row += systStride)
+            dst[iSyst] = weights[rowOffsets[row] + csvBin];
+    }
+}
+
+
+void CSVReweighter::BuildTable(HistogramReader const &readHF, HistogramReader const &readLF)
+{
+    // Reserve the table of row offsets. Every entry is set when the nominal weights are read
+    rowOffsets.resize(GetAllSystVariations().size() * nFlavourClasses * nPtBinsHF * nEtaBinsLF);
+    
+    
+    // Read histograms for b-quark, c-quark, and light-flavour jets
+    ReadWeights(readHF, 0, "", {{SystType::Nominal, SystDirection::Up, ""},
+     {SystType::JEC, SystDirection::Up, "_JESUp"}, {SystType::JEC, SystDirection::Down, "_JESDown"},
+     {SystType::BTagPurityHF, SystDirection::Up, "_LFUp"},
+     {SystType::BTagPurityHF, SystDirection::Down, "_LFDown"},
+     {SystType::BTagStatHF1, SystDirection::Up, "_Stats1Up"},
+     {SystType::BTagStatHF1, SystDirection::Down, "_Stats1Down"},
+     {SystType::BTagStatHF2, SystDirection::Up, "_Stats2Up"},
+     {SystType::BTagStatHF2, SystDirection::Down, "_Stats2Down"}}, nPtBinsHF, 1);
+    
+    ReadWeights(readHF, 1, "c_", {{SystType::Nominal, SystDirection::Up, ""},
+     {SystType::BTagCharmUnc1, SystDirection::Up, "_cErr1Up"},
+     {SystType::BTagCharmUnc1, SystDirection::Down, "_cErr1Down"},
+     {SystType::BTagCharmUnc2, SystDirection::Up, "_cErr2Up"},
+     {SystType::BTagCharmUnc2, SystDirection::Down, "_cErr2Down"}}, nPtBinsHF, 1);
+    
+    ReadWeights(readLF, 2, "", {{SystType::Nominal, SystDirection::Up, ""},
+     {SystType::JEC, SystDirection::Up, "_JESUp"}, {SystType::JEC, SystDirection::Down, "_JESDown"},
+     {SystType::BTagPurityLF, SystDirection::Up, "_HFUp"},
+     {SystType::BTagPurityLF, SystDirection::Down, "_HFDown"},
+     {SystType::BTagStatLF1, SystDirection::Up, "_Stats1Up"},
+     {SystType::BTagStatLF1, SystDirection::Down, "_Stats1Down"},
+     {SystType::BTagStatLF2, SystDirection::Up, "_Stats2Up"},
+     {SystType::BTagStatLF2, SystDirection::Down, "_Stats2Down"}}, nPtBinsLF, nEtaBinsLF);
+}
+
+
+void CSVReweighter::ReadWeights(HistogramReader const &readHistogram, unsigned flavourClass,
+ string const &prefix, initializer_list<WeightSource> const &sources, unsigned nPtBins,
+ unsigned nEtaBins)
+{
+    unsigned const nVariations = GetAllSystVariations().size();
     
-    for (auto const &wp: weightsCharm)
-        for (unsigned iPt = 0; iPt < nPtBinsHF; ++iPt)
-            if (not wp.second[iPt])
+    for (auto const &source: sources)
+    {
+        // Variations whose rows are set from the histograms of this source. The nominal weights
+        //are used for all variations unless they are overwritten by a dedicated source later
+        unsigned systBegin = 0, systEnd = nVariations;
+        
+        if (source.type != SystType::Nominal)
+        {
+            systBegin = GetSystIndex({source.type, source.direction});
+            systEnd = systBegin + 1;
+        }
+        
+        
+        for (unsigned iPt = 0; iPt < nPtBins; ++iPt)
+            for (unsigned iEta = 0; iEta < nEtaBins; ++iEta)
             {
-                ostringstream ost;
-                ost << "Cannot find histogram for c quarks, systematical variation #" <<
-                 unsigned(wp.first) << ", pt bin #" << iPt << ".";
-                 
-                throw runtime_error(ost.str());
+                ostringstream name;
+                name << prefix << "csv_ratio_Pt" << iPt << "_Eta" << iEta << "_final" <<
+                 source.suffix;
+                
+                unsigned const offset = readHistogram(name.str());
+                
+                
+                // Ranges of bins in the table that share this histogram
+                unsigned const ptEnd = (iPt + 1 == nPtBins) ? nPtBinsHF : iPt + 1;
+                unsigned const etaBegin = (nEtaBins == 1) ? 0 : iEta;
+                unsigned const etaEnd = (nEtaBins == 1) ? nEtaBinsLF : iEta + 1;
+                
+                for (unsigned iSyst = systBegin; iSyst < systEnd; ++iSyst)
+                    for (unsigned iPtRow = iPt; iPtRow < ptEnd; ++iPtRow)
+                        for (unsigned iEtaRow = etaBegin; iEtaRow < etaEnd; ++iEtaRow)
+                            rowOffsets[GetRowIndex(iSyst, flavourClass, iPtRow, iEtaRow)] =
+                             offset;
             }
+    }
+}
+
+
+unsigned CSVReweighter::ReadHistogram(TFile &srcFile, string const &name)
+{
+    unique_ptr<TH1> hist(dynamic_cast<TH1 *>(srcFile.Get(name.c_str())));
     
+    if (not hist)
+        throw runtime_error(string("Cannot find histogram \"") + name + "\" in data file \"" +
+         srcFile.GetName() + "\".");
     
-    // Disentangle the histograms for heavy flavours from their parent file, so that the histograms
-    //will not be deleted when the file is closed
-    for (auto const &wp: weightsBottom)
-        for (unsigned iPt = 0; iPt < nPtBinsHF; ++iPt)
-            wp.second[iPt]->SetDirectory(nullptr);
+    // Disentangle the histogram from its parent file so that it is owned by the smart pointer only
+    hist->SetDirectory(nullptr);
     
-    for (auto const &wp: weightsCharm)
-        for (unsigned iPt = 0; iPt < nPtBinsHF; ++iPt)
-                wp.second[iPt]->SetDirectory(nullptr);
     
+    // Only histograms with uniform binning are supported
+    TAxis const *axis = hist->GetXaxis();
     
-    // Read histograms for light flavours
-    for (unsigned iPt = 0; iPt < nPtBinsLF; ++iPt)
-        for (unsigned iEta = 0; iEta < nEtaBinsLF; ++iEta)
-        {
-            ostringstream nameFragment;
-            nameFragment << "csv_ratio_Pt" << iPt << "_Eta" << iEta << "_final";
-            
-            weightsLight[EncodeSyst(SystType::Nominal, SystDirection::Up)][iPt][iEta].reset(
-             dynamic_cast<TH1D *>(dataFileLF->Get(nameFragment.str().c_str())));
-            weightsLight[EncodeSyst(SystType::JEC, SystDirection::Up)][iPt][iEta].reset(
-             dynamic_cast<TH1D *>(dataFileLF->Get((nameFragment.str() + "_JESUp").c_str())));
-            weightsLight[EncodeSyst(SystType::JEC, SystDirection::Down)][iPt][iEta].reset(
-             dynamic_cast<TH1D *>(dataFileLF->Get((nameFragment.str() + "_JESDown").c_str())));
-            weightsLight[EncodeSyst(SystType::BTagPurityLF, SystDirection::Up)][iPt][iEta].reset(
-             dynamic_cast<TH1D *>(dataFileLF->Get((nameFragment.str() + "_HFUp").c_str())));
-            weightsLight[EncodeSyst(SystType::BTagPurityLF, SystDirection::Down)][iPt][iEta].reset(
-             dynamic_cast<TH1D *>(dataFileLF->Get((nameFragment.str() + "_HFDown").c_str())));
-            weightsLight[EncodeSyst(SystType::BTagStatLF1, SystDirection::Up)][iPt][iEta].reset(
-             dynamic_cast<TH1D *>(dataFileLF->Get((nameFragment.str() + "_Stats1Up").c_str())));
-            weightsLight[EncodeSyst(SystType::BTagStatLF1, SystDirection::Down)][iPt][iEta].reset(
-             dynamic_cast<TH1D *>(dataFileLF->Get((nameFragment.str() + "_Stats1Down").c_str())));
-            weightsLight[EncodeSyst(SystType::BTagStatLF2, SystDirection::Up)][iPt][iEta].reset(
-             dynamic_cast<TH1D *>(dataFileLF->Get((nameFragment.str() + "_Stats2Up").c_str())));
-            weightsLight[EncodeSyst(SystType::BTagStatLF2, SystDirection::Down)][iPt][iEta].reset(
-             dynamic_cast<TH1D *>(dataFileLF->Get((nameFragment.str() + "_Stats2Down").c_str())));
-        }
+    if (axis->IsVariableBinSize())
+        throw runtime_error(string("Histogram \"") + name + "\" in data file \"" +
+         srcFile.GetName() + "\" has a non-uniform binning.");
     
     
-    // Make sure all histograms for light flavours have been read
-    for (auto const &wp: weightsLight)
-        for (unsigned iPt = 0; iPt < nPtBinsLF; ++iPt)
-            for (unsigned iEta = 0; iEta < nEtaBinsLF; ++iEta)
-            {
-                if (not wp.second[iPt][iEta])
-                {
-                    ostringstream ost;
-                    ost << "Cannot find histogram for light-flavour quarks, systematical " <<
-                     "variation #" << unsigned(wp.first) << ", pt bin #" << iPt << ".";
-                     
-                    throw runtime_error(ost.str());
-                }
-            }
+    // Copy the content, including the under- and overflow bins
+    unsigned const nBins = axis->GetNbins();
+    vector<double> content(nBins + 2);
     
+    for (unsigned bin = 0; bin < nBins + 2; ++bin)
+        content[bin] = hist->GetBinContent(bin);
     
-    // Disentangle the histograms for light flavours from their parent file
-    for (auto const &wp: weightsLight)
-        for (unsigned iPt = 0; iPt < nPtBinsLF; ++iPt)
-            for (unsigned iEta = 0; iEta < nEtaBinsLF; ++iEta)
-                wp.second[iPt][iEta]->SetDirectory(nullptr);
+    return AddRow(name, nBins, axis->GetXmin(), axis->GetXmax(), content.data());
 }
 
 
-double CSVReweighter::CalculateJetWeight(Jet const &jet,
- SystType systType, SystDirection systDirection) const
+unsigned CSVReweighter::AddRow(string const &name, unsigned nBins, double xMin, double xMax,
+ double const *content)
 {
-    // Find pt and eta bins into which the given jet falls
-    int iPt = -1, iEta = -1;
-    double const pt = jet.Pt();
-    double const absEta = fabs(jet.Eta());
-    
-    for (double const &cut: {20., 30., 40., 60., 100., 160.})
+    // Make sure all histograms share the same binning in CSV
+    if (weights.empty())
     {
-        if (pt < cut)
-            break;
-        
-        ++iPt;
+        nCSVBins = nBins;
+        csvMin = xMin;
+        csvMax = xMax;
     }
     
-    for (double const &cut: {0., 0.8, 1.6, 2.4})
-    {
-        if (absEta < cut)
-            break;
-        
-        ++iEta;
-    }
+    if (nBins != nCSVBins or xMin != csvMin or xMax != csvMax)
+        throw runtime_error(string("Histogram \"") + name +
+         "\" does not have the binning shared by other histograms.");
     
     
-    // If the jet is out of the supported range, return a unit weight
-    if (iPt < 0 or iPt >= int(nPtBinsHF) or iEta < 0 or iEta >= int(nEtaBinsLF))
-        return 1.;
+    // Copy the content, including the under- and overflow bins
+    unsigned const offset = weights.size();
+    weights.insert(weights.end(), content, content + nBins + 2);
     
+    return offset;
+}
+
+
+bool CSVReweighter::FindJetBins(double pt, double eta, double csv, int flavour, unsigned &row,
+ unsigned &csvBin) const noexcept
+{
+    // Find pt and eta bins into which the given jet falls. The bin edges in pt are 20, 30, 40, 60,
+    //100, and 160 GeV, and the ones in absolute pseudorapidity are 0, 0.8, 1.6, and 2.4
+    double const absEta = fabs(eta);
+    int const iPt = int(pt >= 20.) + int(pt >= 30.) + int(pt >= 40.) + int(pt >= 60.) +
+     int(pt >= 100.) + int(pt >= 160.) - 1;
+    int const iEta = int(absEta >= 0.8) + int(absEta >= 1.6) + int(absEta >= 2.4);
     
-    // Encode the requested systematics. Not that if the type is Nominal, only Up variation is
-    //expected
-    if (systType == SystType::Nominal and systDirection == SystDirection::Down)
-        systDirection = SystDirection::Up;
-    
-    SystCode systCode = EncodeSyst(systType, systDirection);
+    if (iPt < 0 or iEta >= int(nEtaBinsLF))
+        return false;
     
     
-    // Calculate the per-jet weight depending on the jet flavour
-    double const csv = jet.BTag();
+    row = GetRowIndex(0, GetFlavourClass(flavour), iPt, iEta);
+    csvBin = FindCSVBin(csv);
     
-    switch (abs(jet.Flavour()))
-    {
-        case 5:  // b-quark jets
-        {
-            // Check for mismatched systematical variation
-            if (weightsBottom.find(systCode) == weightsBottom.end())
-                systCode = EncodeSyst(SystType::Nominal, SystDirection::Up);
-            
-            int const bin = (csv >= 0.) ? weightsBottom[systCode][iPt]->FindFixBin(csv) : 1;
-            return weightsBottom[systCode][iPt]->GetBinContent(bin);
-            
-            break;
-        }
-        
-        case 4:  // c-quark jets
-        {
-            // Check for mismatched systematical variation
-            if (weightsCharm.find(systCode) == weightsCharm.end())
-                systCode = EncodeSyst(SystType::Nominal, SystDirection::Up);
-            
-            int const bin = (csv >= 0.) ? weightsCharm[systCode][iPt]->FindFixBin(csv) : 1;
-            return weightsCharm[systCode][iPt]->GetBinContent(bin);
-            
-            break;
-        }
-        
-        default:  // light-flavour jets
-        {
-            // The pt range for light-flavour is different. Clip the pt accordingly
-            if (iPt > 3)
-                iPt = 3;
-            
-            // Check for mismatched systematical variation
-            if (weightsLight.find(systCode) == weightsLight.end())
-                systCode = EncodeSyst(SystType::Nominal, SystDirection::Up);
-            
-            int const bin = (csv >= 0.) ? weightsLight[systCode][iPt][iEta]->FindFixBin(csv) : 1;
-            return weightsLight[systCode][iPt][iEta]->GetBinContent(bin);
-            
-            break;
-        }
-    }
+    return true;
 }
 
 
-double CSVReweighter::CalculateJetWeight(Jet const &jet) const
+unsigned CSVReweighter::GetRowIndex(unsigned systIndex, unsigned flavourClass, unsigned iPt,
+ unsigned iEta) noexcept
 {
-    return CalculateJetWeight(jet, SystType::Nominal, SystDirection::Up);
+    return ((systIndex * nFlavourClasses + flavourClass) * nPtBinsHF + iPt) * nEtaBinsLF + iEta;
 }
 
 
-CSVReweighter::SystCode CSVReweighter::EncodeSyst(SystType systType, SystDirection systDirection)
+unsigned CSVReweighter::GetFlavourClass(int flavour) noexcept
 {
-    return 2 * unsigned(systType) + unsigned(systDirection);
+    switch (abs(flavour))
+    {
+        case 5:
+            return 0;
+        
+        case 4:
+            return 1;
+        
+        default:
+            return 2;
+    }
+}
+
+
+unsigned CSVReweighter::FindCSVBin(double csv) const noexcept
+{
+    // Jets without tracks are assigned negative values of the discriminator
+    if (csv < 0.)
+        return 1;
+    
+    // Same arithmetic as in TAxis::FindFixBin
+    if (csv < csvMin)
+        return 0;
+    
+    if (not (csv < csvMax))
+        return nCSVBins + 1;
+    
+    return 1 + unsigned(nCSVBins * (csv - csvMin) / (csvMax - csvMin));
 }
@@ -1,12 +1,16 @@
 #pragma once
 
 #include <PhysicsObjects.hpp>
+#include <Collections.hpp>
 #include <Systematics.hpp>
 
-#include <TH1D.h>
+#include <TFile.h>
 
+#include <string>
+#include <vector>
 #include <memory>
-#include <map>
+#include <initializer_list>
+#include <functional>
 
 
 /**
@@ -24,23 +28,91 @@
  */
 class CSVReweighter
 {
+public:
+    /**
+     * \struct EmbeddedHistogram
+     * \brief A histogram with weights compiled into the program
+     * 
+     * Arrays of such objects are produced at build time by the program generateCSVTables from the
+     * data files. Histograms are identified by names of the data files (without directories) and
+     * their own names. The content includes the under- and overflow bins.
+     */
+    struct EmbeddedHistogram
+    {
+        /// Name of the data file from which the histogram was taken
+        char const *fileName;
+        
+        /// Name of the histogram
+        char const *name;
+        
+        /// Number of bins, not including the under- and overflow bins
+        unsigned nBins;
+        
+        /// Range of the axis
+        double xMin, xMax;
+        
+        /// Content of all bins, including the under- and overflow bins
+        double const *content;
+    };
+    
 private:
     /**
-     * \brief A compact representation of a systematical variation
+     * \struct WeightSource
+     * \brief Describes histograms that provide weights for a systematical variation
+     * 
+     * Histograms for a given variation are identified by a common suffix in their names.
+     */
+    struct WeightSource
+    {
+        /// Type of systematics
+        SystType type;
+        
+        /// Direction of the variation
+        SystDirection direction;
+        
+        /// Suffix appended to names of the histograms
+        char const *suffix;
+    };
+    
+public:
+    /**
+     * \brief Type of functions that copy a histogram with the given name into the lookup table
      * 
-     * It combines the type and the direction. The representation is used in the class internally.
+     * The function returns the offset of the copied row in the table.
      */
-    typedef unsigned SystCode;
+    typedef std::function<unsigned(std::string const &name)> HistogramReader;
     
 public:
     /**
-     * \brief Constructor
+     * \brief Default constructor
      * 
-     * Reads histograms with the weights from data files. Throws exceptions if the files are not
-     * found or do not contain required histograms.
+     * Builds the lookup table from the weights embedded into the program at build time from data
+     * files Reader/data/csv_rwt_hf.root and csv_rwt_lf.root. No files are read.
      */
     CSVReweighter();
     
+    /**
+     * \brief Constructor from data files with weights for heavy and light flavours
+     * 
+     * Reads histograms with the weights from the given files and copies their content into the
+     * lookup table. Allows to use a calibration different from the embedded one. Throws exceptions
+     * if the files are not found or do not contain required histograms, or if the histograms do not
+     * share the same binning in CSV.
+     */
+    CSVReweighter(std::string const &hfFileName, std::string const &lfFileName);
+    
+    /// Copy constructor is disabled since instances are meant to be shared
+    CSVReweighter(CSVReweighter const &) = delete;
+    
+public:
+    /**
+     * \brief Returns the process-wide instance constructed with the default data files
+     * 
+     * The instance is created at the first call and shared by all subsequent callers. It is
+     * immutable, and all its methods can be called concurrently from any number of threads.
+     */
+    static std::shared_ptr<CSVReweighter const> GetDefault();
+    
 public:
     /**
      * \brief Calculates per-jet CSV weight
@@ -53,12 +125,96 @@ public:
      */
     double CalculateJetWeight(Jet const &jet, SystType systType, SystDirection systDirection) const;
     
+    /**
+     * \brief Calculates per-jet CSV weight from properties of the jet
+     * 
+     * Allows to evaluate the weight for jets that are not stored as instances of class Jet. See
+     * documentation for the overloaded version for details.
+     */
+    double CalculateJetWeight(double pt, double eta, double bTag, int flavour, SystType systType,
+     SystDirection systDirection) const;
+    
     /// A short-cut to calculate nominal per-jet CSV weight
     double CalculateJetWeight(Jet const &jet) const;
     
+    /**
+     * \brief Calculates per-event CSV weights for all systematical variations at once
+     * 
+     * The weight for a variation is the product of per-jet weights of all jets in the collection,
+     * in which per-jet weights equal to zero are skipped. The weights are written into the given
+     * vector, which is resized to the number of variations and indexed as GetAllSystVariations.
+     * Bins of each jet are found only once and reused for all variations, which makes the call
+     * only marginally more expensive than the calculation of the nominal weight alone.
+     */
+    void CalculateEventWeights(JetCollection const &jets, std::vector<double> &eventWeights) const;
+    
+    /**
+     * \brief Calculates per-jet CSV weights for all jets in the collection and all variations
+     * 
+     * The weight for jet i and variation j (indexed as GetAllSystVariations) is written to
+     * jetWeights[i * nVariations + j], where nVariations is the number of variations. The vector
+     * is resized as needed. Unlike CalculateEventWeights, zero weights are reported as they are.
+     */
+    void CalculateJetWeights(JetCollection const &jets, std::vector<double> &jetWeights) const;
+    
 private:
-    /// Combines type of systematics and direction of the variation into a single code
-    static SystCode EncodeSyst(SystType systType, SystDirection systDirection);
+    /**
+     * \brief Fills the lookup table with weights for all flavours
+     * 
+     * The given functions provide histograms from the data files with weights for heavy and light
+     * flavours respectively.
+     */
+    void BuildTable(HistogramReader const &readHF, HistogramReader const &readLF);
+    
+    /**
+     * \brief Reads weights for the given flavour class
+     * 
+     * Histograms for all given sources are read for each bin in pt and absolute pseudorapidity.
+     * The source for the nominal weights must be the first one. Variations that are not listed are
+     * mapped to the nominal weights. Flavour classes with a single bin in pseudorapidity are
+     * assumed to use the same weights for all bins, and jets with a pt above the range covered
+     * by the histograms use weights from the last bin.
+     */
+    void ReadWeights(HistogramReader const &readHistogram, unsigned flavourClass,
+     std::string const &prefix, std::initializer_list<WeightSource> const &sources,
+     unsigned nPtBins, unsigned nEtaBins);
+    
+    /// Copies content of a histogram from the given file into the lookup table
+    unsigned ReadHistogram(TFile &srcFile, std::string const &name);
+    
+    /**
+     * \brief Copies content of a histogram, including under- and overflow bins, into the table
+     * 
+     * Makes sure the histogram has the same binning as the ones copied before and returns the
+     * offset of the copied row in the table.
+     */
+    unsigned AddRow(std::string const &name, unsigned nBins, double xMin, double xMax,
+     double const *content);
+    
+    /**
+     * \brief Finds bins for a jet with the given properties
+     * 
+     * Sets the index of the row offset for the nominal variation and the bin in CSV. Rows for
+     * other variations are separated from it by multiples of systStride. Returns false if the jet
+     * is outside of the supported range, in which case its weight is one.
+     */
+    bool FindJetBins(double pt, double eta, double csv, int flavour, unsigned &row,
+     unsigned &csvBin) const noexcept;
+    
+    /// Returns index of the row offset for the given variation, flavour class, and kinematic bin
+    static unsigned GetRowIndex(unsigned systIndex, unsigned flavourClass, unsigned iPt,
+     unsigned iEta) noexcept;
+    
+    /// Returns class of the jet flavour: 0 for b-quark, 1 for c-quark, 2 for light-flavour jets
+    static unsigned GetFlavourClass(int flavour) noexcept;
+    
+    /**
+     * \brief Finds the bin in CSV for the given value of the discriminator
+     * 
+     * Reproduces TAxis::FindFixBin. Negative values, which are assigned to jets without tracks,
+     * are mapped to the first bin.
+     */
+    unsigned FindCSVBin(double csv) const noexcept;
     
 private:
     /// Number of bins in pt in histograms for heavy-flavour jets
@@ -70,12 +226,34 @@ private:
     /// Number of bins in absolute pseudorapidity in histograms for light-flavour jets
     static unsigned const nEtaBinsLF = 3;
     
-    /// Histograms with weights for b-quark jets
-    mutable std::map<SystCode, std::unique_ptr<TH1D>[nPtBinsHF]> weightsBottom;
+    /// Number of flavour classes (b-quark, c-quark, and light-flavour jets)
+    static unsigned const nFlavourClasses = 3;
+    
+    /// Distance between row offsets for consecutive variations
+    static unsigned const systStride = nFlavourClasses * nPtBinsHF * nEtaBinsLF;
+    
+    /// Number of bins in CSV in the histograms with weights, not including under- and overflow
+    unsigned nCSVBins;
     
-    /// Histograms with weights for c-quark jets
-    mutable std::map<SystCode, std::unique_ptr<TH1D>[nPtBinsHF]> weightsCharm;
+    /// Range of the CSV axis of the histograms with weights
+    double csvMin, csvMax;
     
-    /// Histograms with weights for light-flavour jets
-    mutable std::map<SystCode, std::unique_ptr<TH1D>[nPtBinsLF][nEtaBinsLF]> weightsLight;
+    /**
+     * \brief Weights from all histograms stored contiguously
+     * 
+     * Each histogram occupies a row of (nCSVBins + 2) elements, which includes the under- and
+     * overflow bins.
+     */
+    std::vector<double> weights;
+    
+    /**
+     * \brief Offsets of rows in the table of weights
+     * 
+     * Indexed with [systematical variation][flavour class][pt bin][eta bin], where variations are
+     * numbered as in GetSystIndex. The binning in pt is the one for heavy-flavour jets, and the
+     * binning in pseudorapidity is the one for light-flavour jets. Bins and variations that have
+     * no dedicated histogram point to the rows that should be used for them, so that no resolution
+     * is needed in the lookup.
+     */
+    std::vector<unsigned> rowOffsets;
 };
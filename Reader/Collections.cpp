@@ -0,0 +1,197 @@
+#include <Collections.hpp>
+
+#include <Kinematics.hpp>
+
+#include <algorithm>
+#include <functional>
+
+
+using namespace std;
+
+
+CandidateCollection::CandidateCollection() noexcept:
+    nObjects(0)
+{}
+
+
+void CandidateCollection::ComputeCartesian(float *px, float *py, float *pz, float *e) const
+ noexcept
+{
+    ConvertToCartesian(nObjects, pt.data(), eta.data(), phi.data(), mass.data(), px, py, pz, e);
+}
+
+
+void CandidateCollection::ComputeDeltaR(CandidateCollection const &other, float *deltaR) const
+ noexcept
+{
+    ComputeDeltaRMatrix(nObjects, eta.data(), phi.data(), other.nObjects, other.eta.data(),
+     other.phi.data(), deltaR);
+}
+
+
+void CandidateCollection::FindNearest(CandidateCollection const &other, int *indices,
+ float *deltaR) const noexcept
+{
+    ::FindNearest(nObjects, eta.data(), phi.data(), other.nObjects, other.eta.data(),
+     other.phi.data(), indices, deltaR);
+}
+
+
+void CandidateCollection::ReserveKinematics(unsigned capacity)
+{
+    if (capacity <= GetCapacity())
+        return;
+    
+    pt.resize(capacity);
+    eta.resize(capacity);
+    phi.resize(capacity);
+    mass.resize(capacity);
+    
+    order.resize(capacity);
+    placed.resize(capacity);
+}
+
+
+void CandidateCollection::SetKinematics(unsigned index, double pt_, double eta_, double phi_,
+ double mass_) noexcept
+{
+    pt[index] = pt_;
+    eta[index] = eta_;
+    phi[index] = phi_;
+    mass[index] = mass_;
+}
+
+
+bool CandidateCollection::FindOrderInPt()
+{
+    // In the majority of events the objects are already ordered in the input file
+    if (is_sorted(pt.begin(), pt.begin() + nObjects, greater<float>()))
+        return false;
+    
+    for (unsigned i = 0; i < nObjects; ++i)
+        order[i] = i;
+    
+    stable_sort(order.begin(), order.begin() + nObjects,
+     [this](unsigned i, unsigned j){return pt[i] > pt[j];});
+    
+    return true;
+}
+
+
+void CandidateCollection::ReorderKinematics() noexcept
+{
+    Reorder(pt);
+    Reorder(eta);
+    Reorder(phi);
+    Reorder(mass);
+}
+
+
+JetRef::operator Jet() const noexcept
+{
+    return Jet(Pt(), Eta(), Phi(), BTag(), Flavour());
+}
+
+
+void JetCollection::clear() noexcept
+{
+    nObjects = 0;
+}
+
+
+void JetCollection::emplace_back(double pt_, double eta_, double phi_, double bTag_,
+ int flavour_ /*= 0*/)
+{
+    if (nObjects == GetCapacity())
+        SetCapacity(max(2 * nObjects, 16u));
+    
+    SetKinematics(nObjects, pt_, eta_, phi_, 0.);
+    bTag[nObjects] = bTag_;
+    flavour[nObjects] = flavour_;
+    ++nObjects;
+}
+
+
+void JetCollection::SetCapacity(unsigned capacity)
+{
+    if (capacity <= GetCapacity())
+        return;
+    
+    ReserveKinematics(capacity);
+    bTag.resize(capacity);
+    flavour.resize(capacity);
+}
+
+
+void JetCollection::SetSize(unsigned size) noexcept
+{
+    // Masses of jets are always zero and need not be set
+    nObjects = min(size, GetCapacity());
+}
+
+
+void JetCollection::SortInPt()
+{
+    if (not FindOrderInPt())
+        return;
+    
+    ReorderKinematics();
+    Reorder(bTag);
+    Reorder(flavour);
+}
+
+
+LeptonRef::operator Lepton() const noexcept
+{
+    return Lepton(Flavour(), Pt(), Eta(), Phi(), Isolation());
+}
+
+
+void LeptonCollection::clear() noexcept
+{
+    nObjects = 0;
+}
+
+
+void LeptonCollection::emplace_back(int flavour_, double pt_, double eta_, double phi_,
+ double isolation_)
+{
+    if (nObjects == GetCapacity())
+        SetCapacity(max(2 * nObjects, 16u));
+    
+    SetKinematics(nObjects, pt_, eta_, phi_, Lepton::GetMass(flavour_));
+    isolation[nObjects] = isolation_;
+    flavour[nObjects] = flavour_;
+    ++nObjects;
+}
+
+
+void LeptonCollection::SetCapacity(unsigned capacity)
+{
+    if (capacity <= GetCapacity())
+        return;
+    
+    ReserveKinematics(capacity);
+    isolation.resize(capacity);
+    flavour.resize(capacity);
+}
+
+
+void LeptonCollection::SetSize(unsigned size) noexcept
+{
+    nObjects = min(size, GetCapacity());
+    
+    for (unsigned i = 0; i < nObjects; ++i)
+        mass[i] = Lepton::GetMass(flavour[i]);
+}
+
+
+void LeptonCollection::SortInPt()
+{
+    if (not FindOrderInPt())
+        return;
+    
+    ReorderKinematics();
+    Reorder(isolation);
+    Reorder(flavour);
+}
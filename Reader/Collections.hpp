@@ -0,0 +1,793 @@
+#pragma once
+
+#include <PhysicsObjects.hpp>
+
+#include <TLorentzVector.h>
+
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <cstddef>
+#include <cmath>
+
+
+/**
+ * \class CandidateCollection
+ * \brief Base class for collections of reconstructed objects stored as a structure of arrays
+ * 
+ * Each property of the objects is stored in a separate contiguous array, which can be accessed
+ * directly for fast loops over the collection. Individual objects are accessed by light-weight
+ * proxies that reproduce the interface of the corresponding classes derived from Candidate. Thus,
+ * code like jets[i].Pt() or a range-based loop over the collection works as for a vector of
+ * objects.
+ */
+class CandidateCollection
+{
+public:
+    /// Constructor
+    CandidateCollection() noexcept;
+    
+public:
+    /// Returns the number of objects in the collection
+    unsigned size() const noexcept;
+    
+    /// Checks if the collection is empty
+    bool empty() const noexcept;
+    
+    /// Returns the number of objects that can be stored without reallocation of the arrays
+    unsigned GetCapacity() const noexcept;
+    
+    /// Returns the array of transverse momenta
+    float const *PtArray() const noexcept;
+    
+    /// Returns the array of pseudorapidities
+    float const *EtaArray() const noexcept;
+    
+    /// Returns the array of azimuthal angles
+    float const *PhiArray() const noexcept;
+    
+    /// Returns the array of masses
+    float const *MassArray() const noexcept;
+    
+    /**
+     * \brief Computes Cartesian components of four-momenta of all objects
+     * 
+     * The output arrays must hold size() elements each. The computation is vectorised, see
+     * documentation for the function ConvertToCartesian.
+     */
+    void ComputeCartesian(float *px, float *py, float *pz, float *e) const noexcept;
+    
+    /**
+     * \brief Computes distances in the (eta, phi) space to all objects of another collection
+     * 
+     * The distance between object i of this collection and object j of the other one is written
+     * to deltaR[i * other.size() + j]. The output array must hold size() * other.size() elements.
+     * The computation is vectorised, see documentation for the function ComputeDeltaRMatrix.
+     */
+    void ComputeDeltaR(CandidateCollection const &other, float *deltaR) const noexcept;
+    
+    /**
+     * \brief Finds the closest object of another collection for each object in this one
+     * 
+     * Indices of the closest objects and distances to them in the (eta, phi) space are written to
+     * the given arrays, which must hold size() elements each. If the other collection is empty,
+     * the indices and the distances are set to -1. Useful for cleaning of jets against leptons and
+     * for matching. See documentation for the function FindNearest.
+     */
+    void FindNearest(CandidateCollection const &other, int *indices, float *deltaR) const
+     noexcept;
+    
+    /**
+     * \brief Returns a writable array of transverse momenta
+     * 
+     * Writable arrays allow to fill the collection in place, e.g. by using them as buffers to read
+     * a ROOT tree. The number of objects must then be set with the method SetSize of the derived
+     * class. Pointers to the arrays are invalidated when the capacity changes.
+     */
+    float *PtBuffer() noexcept;
+    
+    /// Returns a writable array of pseudorapidities, see documentation for PtBuffer
+    float *EtaBuffer() noexcept;
+    
+    /// Returns a writable array of azimuthal angles, see documentation for PtBuffer
+    float *PhiBuffer() noexcept;
+    
+protected:
+    /// Makes sure the kinematic arrays can hold the given number of objects
+    void ReserveKinematics(unsigned capacity);
+    
+    /// Sets kinematics of the object with the given index
+    void SetKinematics(unsigned index, double pt, double eta, double phi, double mass) noexcept;
+    
+    /**
+     * \brief Finds the order of objects in the decreasing pt
+     * 
+     * The order is stored as a permutation of indices of the objects. Returns false, leaving the
+     * permutation unspecified, if the objects are already ordered.
+     */
+    bool FindOrderInPt();
+    
+    /// Reorders kinematic arrays according to the permutation found by FindOrderInPt
+    void ReorderKinematics() noexcept;
+    
+    /**
+     * \brief Reorders the first size() elements of the given array according to the permutation
+     * found by FindOrderInPt
+     * 
+     * The array is permuted in place by following cycles of the permutation.
+     */
+    template<typename T>
+    void Reorder(std::vector<T> &array) noexcept;
+    
+protected:
+    /// Kinematic properties of the objects
+    std::vector<float> pt, eta, phi, mass;
+    
+    /**
+     * \brief Number of objects in the collection
+     * 
+     * The arrays can be longer. Their elements beyond this number are not used.
+     */
+    unsigned nObjects;
+    
+private:
+    /// Permutation that orders the objects in pt
+    std::vector<unsigned> order;
+    
+    /// Flags used to follow cycles of the permutation
+    std::vector<bool> placed;
+};
+
+
+/**
+ * \class CandidateRef
+ * \brief Proxy to access an object in a collection
+ * 
+ * Reproduces the interface of the class Candidate. The proxy is only valid as long as the
+ * collection is not modified.
+ */
+template<typename Collection>
+class CandidateRef
+{
+public:
+    /// Constructor from a collection and an index of the object in it
+    CandidateRef(Collection const &collection, unsigned index) noexcept;
+    
+public:
+    /// Returns the four-momentum as a TLorentzVector
+    TLorentzVector P4() const;
+    
+    /// Transverse momentum
+    double Pt() const noexcept;
+    
+    /// Pseudorapidity
+    double Eta() const noexcept;
+    
+    /// Azimuthal angle
+    double Phi() const noexcept;
+    
+    /// Mass
+    double M() const noexcept;
+    
+    /// Projection of the momentum on the x axis
+    double Px() const noexcept;
+    
+    /// Projection of the momentum on the y axis
+    double Py() const noexcept;
+    
+    /// Projection of the momentum on the z axis
+    double Pz() const noexcept;
+    
+    /// Energy
+    double E() const noexcept;
+    
+    /// Distance in the (eta, phi) space to another object or proxy
+    template<typename T>
+    double DeltaR(T const &rhs) const noexcept;
+    
+protected:
+    /// Collection to which the object belongs
+    Collection const *collection;
+    
+    /// Index of the object in the collection
+    unsigned index;
+};
+
+
+/**
+ * \class CollectionIterator
+ * \brief Iterator over a collection that dereferences into proxies
+ */
+template<typename Collection, typename Ref>
+class CollectionIterator
+{
+public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef Ref value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef Ref const *pointer;
+    typedef Ref reference;
+    
+public:
+    /// Constructor from a collection and an index of the object in it
+    CollectionIterator(Collection const &collection, unsigned index) noexcept;
+    
+public:
+    /// Returns a proxy for the current object
+    Ref operator*() const noexcept;
+    
+    /// Moves to the next object
+    CollectionIterator &operator++() noexcept;
+    
+    /// Moves to the next object
+    CollectionIterator operator++(int) noexcept;
+    
+    /// Comparison operator
+    bool operator==(CollectionIterator const &rhs) const noexcept;
+    
+    /// Comparison operator
+    bool operator!=(CollectionIterator const &rhs) const noexcept;
+    
+private:
+    /// Collection being iterated over
+    Collection const *collection;
+    
+    /// Index of the current object
+    unsigned index;
+};
+
+
+class JetCollection;
+
+
+/**
+ * \class JetRef
+ * \brief Proxy to access a jet in a JetCollection
+ * 
+ * Reproduces the interface of the class Jet and can be converted into it.
+ */
+class JetRef: public CandidateRef<JetCollection>
+{
+public:
+    /// Constructor from a collection and an index of the jet in it
+    JetRef(JetCollection const &collection, unsigned index) noexcept;
+    
+public:
+    /// Returns jet flavour, see documentation for Jet::Flavour
+    int Flavour() const noexcept;
+    
+    /// Returns value of the b-tagging discriminator
+    double BTag() const noexcept;
+    
+    /// Creates a standalone copy of the jet
+    operator Jet() const noexcept;
+};
+
+
+/**
+ * \class JetCollection
+ * \brief A collection of jets stored as a structure of arrays
+ */
+class JetCollection: public CandidateCollection
+{
+public:
+    /// Type of iterators
+    typedef CollectionIterator<JetCollection, JetRef> const_iterator;
+    
+public:
+    /// Removes all jets, keeping the allocated memory
+    void clear() noexcept;
+    
+    /// Adds a new jet
+    void emplace_back(double pt, double eta, double phi, double bTag, int flavour = 0);
+    
+    /**
+     * \brief Makes sure the arrays can hold the given number of jets
+     * 
+     * The arrays are never shrunk.
+     */
+    void SetCapacity(unsigned capacity);
+    
+    /**
+     * \brief Sets the number of jets after the arrays have been filled in place
+     * 
+     * The number is clipped to the capacity. Jets are massless.
+     */
+    void SetSize(unsigned size) noexcept;
+    
+    /// Returns a proxy for the jet with the given index
+    JetRef operator[](unsigned index) const noexcept;
+    
+    /// Returns a proxy for the first jet
+    JetRef front() const noexcept;
+    
+    /// Iterator pointing to the first jet
+    const_iterator begin() const noexcept;
+    
+    /// Iterator pointing past the last jet
+    const_iterator end() const noexcept;
+    
+    /// Returns the array of values of the b-tagging discriminator
+    float const *BTagArray() const noexcept;
+    
+    /// Returns the array of flavours
+    int const *FlavourArray() const noexcept;
+    
+    /// Returns a writable array of values of the b-tagging discriminator
+    float *BTagBuffer() noexcept;
+    
+    /// Returns a writable array of flavours
+    int *FlavourBuffer() noexcept;
+    
+    /**
+     * \brief Orders jets in pt, in the decreasing order
+     * 
+     * Nothing is done if the jets are already ordered.
+     */
+    void SortInPt();
+    
+private:
+    /// Values of the b-tagging discriminator
+    std::vector<float> bTag;
+    
+    /// Flavours
+    std::vector<int> flavour;
+};
+
+
+class LeptonCollection;
+
+
+/**
+ * \class LeptonRef
+ * \brief Proxy to access a lepton in a LeptonCollection
+ * 
+ * Reproduces the interface of the class Lepton and can be converted into it.
+ */
+class LeptonRef: public CandidateRef<LeptonCollection>
+{
+public:
+    /// Constructor from a collection and an index of the lepton in it
+    LeptonRef(LeptonCollection const &collection, unsigned index) noexcept;
+    
+public:
+    /// Returns lepton flavour, see documentation for Lepton::Flavour
+    int Flavour() const noexcept;
+    
+    /// Returns lepton isolation
+    double Isolation() const noexcept;
+    
+    /// Creates a standalone copy of the lepton
+    operator Lepton() const noexcept;
+};
+
+
+/**
+ * \class LeptonCollection
+ * \brief A collection of leptons stored as a structure of arrays
+ */
+class LeptonCollection: public CandidateCollection
+{
+public:
+    /// Type of iterators
+    typedef CollectionIterator<LeptonCollection, LeptonRef> const_iterator;
+    
+public:
+    /// Removes all leptons, keeping the allocated memory
+    void clear() noexcept;
+    
+    /**
+     * \brief Adds a new lepton
+     * 
+     * The mass is set according to the flavour.
+     */
+    void emplace_back(int flavour, double pt, double eta, double phi, double isolation);
+    
+    /**
+     * \brief Makes sure the arrays can hold the given number of leptons
+     * 
+     * The arrays are never shrunk.
+     */
+    void SetCapacity(unsigned capacity);
+    
+    /**
+     * \brief Sets the number of leptons after the arrays have been filled in place
+     * 
+     * The number is clipped to the capacity. Masses of the leptons are set according to their
+     * flavours.
+     */
+    void SetSize(unsigned size) noexcept;
+    
+    /// Returns a proxy for the lepton with the given index
+    LeptonRef operator[](unsigned index) const noexcept;
+    
+    /// Returns a proxy for the first lepton
+    LeptonRef front() const noexcept;
+    
+    /// Iterator pointing to the first lepton
+    const_iterator begin() const noexcept;
+    
+    /// Iterator pointing past the last lepton
+    const_iterator end() const noexcept;
+    
+    /// Returns the array of isolations
+    float const *IsolationArray() const noexcept;
+    
+    /// Returns the array of flavours
+    int const *FlavourArray() const noexcept;
+    
+    /// Returns a writable array of isolations
+    float *IsolationBuffer() noexcept;
+    
+    /// Returns a writable array of flavours
+    int *FlavourBuffer() noexcept;
+    
+    /**
+     * \brief Orders leptons in pt, in the decreasing order
+     * 
+     * Nothing is done if the leptons are already ordered.
+     */
+    void SortInPt();
+    
+private:
+    /// Isolations
+    std::vector<float> isolation;
+    
+    /// Flavours
+    std::vector<int> flavour;
+};
+
+
+// Definitions of short methods are provided in the header so that they can be inlined in loops
+//over collections
+
+inline unsigned CandidateCollection::size() const noexcept
+{
+    return nObjects;
+}
+
+
+inline bool CandidateCollection::empty() const noexcept
+{
+    return (nObjects == 0);
+}
+
+
+inline unsigned CandidateCollection::GetCapacity() const noexcept
+{
+    return pt.size();
+}
+
+
+inline float const *CandidateCollection::PtArray() const noexcept
+{
+    return pt.data();
+}
+
+
+inline float const *CandidateCollection::EtaArray() const noexcept
+{
+    return eta.data();
+}
+
+
+inline float const *CandidateCollection::PhiArray() const noexcept
+{
+    return phi.data();
+}
+
+
+inline float const *CandidateCollection::MassArray() const noexcept
+{
+    return mass.data();
+}
+
+
+inline float *CandidateCollection::PtBuffer() noexcept
+{
+    return pt.data();
+}
+
+
+inline float *CandidateCollection::EtaBuffer() noexcept
+{
+    return eta.data();
+}
+
+
+inline float *CandidateCollection::PhiBuffer() noexcept
+{
+    return phi.data();
+}
+
+
+template<typename T>
+void CandidateCollection::Reorder(std::vector<T> &array) noexcept
+{
+    // The element with index i must receive the value from index order[i]. Move the values along
+    //each cycle of the permutation, starting from its smallest index
+    std::fill(placed.begin(), placed.begin() + nObjects, false);
+    
+    for (unsigned start = 0; start < nObjects; ++start)
+    {
+        if (placed[start])
+            continue;
+        
+        T const startValue = array[start];
+        unsigned i = start;
+        
+        while (order[i] != start)
+        {
+            array[i] = array[order[i]];
+            placed[i] = true;
+            i = order[i];
+        }
+        
+        array[i] = startValue;
+        placed[i] = true;
+    }
+}
+
+
+template<typename Collection>
+inline CandidateRef<Collection>::CandidateRef(Collection const &collection_, unsigned index_)
+ noexcept:
+    collection(&collection_), index(index_)
+{}
+
+
+template<typename Collection>
+TLorentzVector CandidateRef<Collection>::P4() const
+{
+    TLorentzVector p4;
+    p4.SetPtEtaPhiM(Pt(), Eta(), Phi(), M());
+    
+    return p4;
+}
+
+
+template<typename Collection>
+inline double CandidateRef<Collection>::Pt() const noexcept
+{
+    return collection->PtArray()[index];
+}
+
+
+template<typename Collection>
+inline double CandidateRef<Collection>::Eta() const noexcept
+{
+    return collection->EtaArray()[index];
+}
+
+
+template<typename Collection>
+inline double CandidateRef<Collection>::Phi() const noexcept
+{
+    return collection->PhiArray()[index];
+}
+
+
+template<typename Collection>
+inline double CandidateRef<Collection>::M() const noexcept
+{
+    return collection->MassArray()[index];
+}
+
+
+template<typename Collection>
+inline double CandidateRef<Collection>::Px() const noexcept
+{
+    return Pt() * std::cos(Phi());
+}
+
+
+template<typename Collection>
+inline double CandidateRef<Collection>::Py() const noexcept
+{
+    return Pt() * std::sin(Phi());
+}
+
+
+template<typename Collection>
+inline double CandidateRef<Collection>::Pz() const noexcept
+{
+    return Pt() * std::sinh(Eta());
+}
+
+
+template<typename Collection>
+inline double CandidateRef<Collection>::E() const noexcept
+{
+    double const p = Pt() * std::cosh(Eta());
+    return std::sqrt(p * p + M() * M());
+}
+
+
+template<typename Collection>
+template<typename T>
+inline double CandidateRef<Collection>::DeltaR(T const &rhs) const noexcept
+{
+    double const dEta = Eta() - rhs.Eta();
+    double const dPhi = std::remainder(Phi() - rhs.Phi(), 2 * M_PI);
+    
+    return std::sqrt(dEta * dEta + dPhi * dPhi);
+}
+
+
+template<typename Collection, typename Ref>
+inline CollectionIterator<Collection, Ref>::CollectionIterator(Collection const &collection_,
+ unsigned index_) noexcept:
+    collection(&collection_), index(index_)
+{}
+
+
+template<typename Collection, typename Ref>
+inline Ref CollectionIterator<Collection, Ref>::operator*() const noexcept
+{
+    return Ref(*collection, index);
+}
+
+
+template<typename Collection, typename Ref>
+inline CollectionIterator<Collection, Ref> &CollectionIterator<Collection, Ref>::operator++()
+ noexcept
+{
+    ++index;
+    return *this;
+}
+
+
+template<typename Collection, typename Ref>
+inline CollectionIterator<Collection, Ref> CollectionIterator<Collection, Ref>::operator++(int)
+ noexcept
+{
+    CollectionIterator const orig(*this);
+    ++index;
+    return orig;
+}
+
+
+template<typename Collection, typename Ref>
+inline bool CollectionIterator<Collection, Ref>::operator==(CollectionIterator const &rhs) const
+ noexcept
+{
+    return (index == rhs.index and collection == rhs.collection);
+}
+
+
+template<typename Collection, typename Ref>
+inline bool CollectionIterator<Collection, Ref>::operator!=(CollectionIterator const &rhs) const
+ noexcept
+{
+    return not (*this == rhs);
+}
+
+
+inline JetRef::JetRef(JetCollection const &collection_, unsigned index_) noexcept:
+    CandidateRef<JetCollection>(collection_, index_)
+{}
+
+
+inline int JetRef::Flavour() const noexcept
+{
+    return collection->FlavourArray()[index];
+}
+
+
+inline double JetRef::BTag() const noexcept
+{
+    return collection->BTagArray()[index];
+}
+
+
+inline JetRef JetCollection::operator[](unsigned index) const noexcept
+{
+    return JetRef(*this, index);
+}
+
+
+inline JetRef JetCollection::front() const noexcept
+{
+    return JetRef(*this, 0);
+}
+
+
+inline JetCollection::const_iterator JetCollection::begin() const noexcept
+{
+    return const_iterator(*this, 0);
+}
+
+
+inline JetCollection::const_iterator JetCollection::end() const noexcept
+{
+    return const_iterator(*this, size());
+}
+
+
+inline float const *JetCollection::BTagArray() const noexcept
+{
+    return bTag.data();
+}
+
+
+inline int const *JetCollection::FlavourArray() const noexcept
+{
+    return flavour.data();
+}
+
+
+inline float *JetCollection::BTagBuffer() noexcept
+{
+    return bTag.data();
+}
+
+
+inline int *JetCollection::FlavourBuffer() noexcept
+{
+    return flavour.data();
+}
+
+
+inline LeptonRef::LeptonRef(LeptonCollection const &collection_, unsigned index_) noexcept:
+    CandidateRef<LeptonCollection>(collection_, index_)
+{}
+
+
+inline int LeptonRef::Flavour() const noexcept
+{
+    return collection->FlavourArray()[index];
+}
+
+
+inline double LeptonRef::Isolation() const noexcept
+{
+    return collection->IsolationArray()[index];
+}
+
+
+inline LeptonRef LeptonCollection::operator[](unsigned index) const noexcept
+{
+    return LeptonRef(*this, index);
+}
+
+
+inline LeptonRef LeptonCollection::front() const noexcept
+{
+    return LeptonRef(*this, 0);
+}
+
+
+inline LeptonCollection::const_iterator LeptonCollection::begin() const noexcept
+{
+    return const_iterator(*this, 0);
+}
+
+
+inline LeptonCollection::const_iterator LeptonCollection::end() const noexcept
+{
+    return const_iterator(*this, size());
+}
+
+
+inline float const *LeptonCollection::IsolationArray() const noexcept
+{
+    return isolation.data();
+}
+
+
+inline int const *LeptonCollection::FlavourArray() const noexcept
+{
+    return flavour.data();
+}
+
+
+inline float *LeptonCollection::IsolationBuffer() noexcept
+{
+    return isolation.data();
+}
+
+
+inline int *LeptonCollection::FlavourBuffer() noexcept
+{
+    return flavour.data();
+}
@@ -0,0 +1,168 @@
+#include <DerivedQuantities.hpp>
+
+#include <stdexcept>
+#include <sstream>
+#include <limits>
+
+
+using namespace std;
+
+
+DerivedQuantities::DerivedQuantities(Reader &reader_):
+    reader(reader_), nKinematicGroups(1)
+{
+    // Group variations by kinematics. Variations that do not alter kinematics share the group of
+    //the nominal configuration, and each kinematic variation is given a group of its own
+    for (auto const &v: GetAllSystVariations())
+        kinematicGroups.push_back((IsKinematic(v.type)) ? nKinematicGroups++ : 0);
+}
+
+
+unsigned DerivedQuantities::Define(string const &name,
+ initializer_list<string> const &dependencies, SystDependence dependence,
+ Calculator const &calculator)
+{
+    if (indices.find(name) != indices.end())
+    {
+        ostringstream ost;
+        ost << "Quantity \"" << name << "\" has already been defined.";
+        throw logic_error(ost.str());
+    }
+    
+    
+    // The quantity inherits the strongest dependence on systematics from its dependencies
+    for (auto const &d: dependencies)
+    {
+        auto const res = indices.find(d);
+        
+        if (res == indices.end())
+        {
+            ostringstream ost;
+            ost << "Quantity \"" << name << "\" depends on quantity \"" << d <<
+             "\", which has not been defined.";
+            throw logic_error(ost.str());
+        }
+        
+        SystDependence const inherited = quantities[res->second].dependence;
+        
+        if (unsigned(inherited) > unsigned(dependence))
+            dependence = inherited;
+    }
+    
+    
+    // Register the quantity and allocate cache slots for it
+    unsigned const index = quantities.size();
+    quantities.push_back({name, calculator, dependence, unsigned(values.size()), false});
+    indices[name] = index;
+    
+    unsigned const nSlots = GetNumSlots(dependence);
+    values.resize(values.size() + nSlots);
+    stamps.resize(stamps.size() + nSlots, numeric_limits<unsigned long>::max());
+    
+    
+    return index;
+}
+
+
+unsigned DerivedQuantities::GetNumQuantities() const noexcept
+{
+    return quantities.size();
+}
+
+
+unsigned DerivedQuantities::GetIndex(string const &name) const
+{
+    auto const res = indices.find(name);
+    
+    if (res == indices.end())
+    {
+        ostringstream ost;
+        ost << "Quantity \"" << name << "\" has not been defined.";
+        throw logic_error(ost.str());
+    }
+    
+    return res->second;
+}
+
+
+double DerivedQuantities::Get(unsigned index)
+{
+    if (index >= quantities.size())
+        throw logic_error("Index of a derived quantity is out of range.");
+    
+    Quantity &q = quantities[index];
+    
+    
+    // Check if the value has already been computed in the current event
+    unsigned const slot = q.firstSlot + GetSlotOffset(q.dependence);
+    unsigned long const eventCounter = reader.GetEventCounter();
+    
+    if (stamps[slot] == eventCounter)
+        return values[slot];
+    
+    
+    // Compute the value. Since dependencies are declared before their users, a cycle can only
+    //appear if a function requests a quantity it has not declared as a dependency
+    if (q.beingComputed)
+    {
+        ostringstream ost;
+        ost << "Cyclic dependency encountered while computing quantity \"" << q.name << "\".";
+        throw logic_error(ost.str());
+    }
+    
+    q.beingComputed = true;
+    
+    try
+    {
+        values[slot] = q.calculator(reader, *this);
+    }
+    catch (...)
+    {
+        q.beingComputed = false;
+        throw;
+    }
+    
+    q.beingComputed = false;
+    stamps[slot] = eventCounter;
+    
+    
+    return values[slot];
+}
+
+
+double DerivedQuantities::Get(string const &name)
+{
+    return Get(GetIndex(name));
+}
+
+
+unsigned DerivedQuantities::GetNumSlots(SystDependence dependence) const noexcept
+{
+    switch (dependence)
+    {
+        case SystDependence::None:
+            return 1;
+        
+        case SystDependence::Kinematic:
+            return nKinematicGroups;
+        
+        default:
+            return kinematicGroups.size();
+    }
+}
+
+
+unsigned DerivedQuantities::GetSlotOffset(SystDependence dependence) const noexcept
+{
+    switch (dependence)
+    {
+        case SystDependence::None:
+            return 0;
+        
+        case SystDependence::Kinematic:
+            return kinematicGroups[GetSystIndex(reader.GetSystematics())];
+        
+        default:
+            return GetSystIndex(reader.GetSystematics());
+    }
+}
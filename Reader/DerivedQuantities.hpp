@@ -0,0 +1,152 @@
+#pragma once
+
+#include <Reader.hpp>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <initializer_list>
+
+
+/**
+ * \brief Describes how a derived quantity depends on systematical variations
+ * 
+ * Determines how many values of the quantity are cached per event.
+ */
+enum class SystDependence
+{
+    /// The quantity is the same for all variations, e.g. it depends on leptons only
+    None,
+    
+    /// The quantity depends on kinematics of objects, e.g. on jets or MET
+    Kinematic,
+    
+    /// The quantity can differ for every variation, e.g. it depends on the event weight
+    All
+};
+
+
+/**
+ * \class DerivedQuantities
+ * \brief Lazily evaluated and cached per-event quantities computed from a Reader
+ * 
+ * Quantities are declared once, each with a name, a function that computes it, and a list of other
+ * quantities it depends on. A quantity is computed when it is requested for the first time in the
+ * current event with the current systematical variation, and the result is cached. Thus, however
+ * many histograms use a quantity, it is evaluated at most once per event and variation. The cache
+ * is invalidated automatically when the reader moves to another event or the b-tagging reweighting
+ * is switched; the current variation is looked up from the reader at each request.
+ * 
+ * Values of a quantity that depends only on kinematics are shared among all variations that do not
+ * alter kinematics. A quantity inherits the strongest dependence of the quantities it depends on.
+ * Dependencies must be declared before the quantities that use them, which guarantees that there
+ * are no cycles.
+ * 
+ * An example:
+ *   DerivedQuantities q(reader);
+ *   q.Define("HT", {}, SystDependence::Kinematic, [](Reader &r, DerivedQuantities &)
+ *    {double ht = 0.; for (auto const j: r.GetJets()) ht += j.Pt(); return ht;});
+ *   q.Define("HTWeighted", {"HT"}, SystDependence::All, [](Reader &r, DerivedQuantities &q)
+ *    {return q.Get("HT") * r.GetWeight();});
+ */
+class DerivedQuantities
+{
+public:
+    /**
+     * \brief Type of functions that compute quantities
+     * 
+     * The function receives the reader and the collection of quantities, which allows it to
+     * request values of its dependencies.
+     */
+    typedef std::function<double(Reader &reader, DerivedQuantities &quantities)> Calculator;
+    
+public:
+    /// Constructor from a reader, which must outlive the object
+    DerivedQuantities(Reader &reader);
+    
+public:
+    /**
+     * \brief Declares a new quantity and returns its index
+     * 
+     * The index can be used to request the quantity faster than with its name. Throws an
+     * exception if a quantity with the same name exists already or a dependency has not been
+     * declared.
+     */
+    unsigned Define(std::string const &name, std::initializer_list<std::string> const &dependencies,
+     SystDependence dependence, Calculator const &calculator);
+    
+    /// Returns the number of declared quantities
+    unsigned GetNumQuantities() const noexcept;
+    
+    /// Returns the index of the quantity with the given name; throws if it does not exist
+    unsigned GetIndex(std::string const &name) const;
+    
+    /**
+     * \brief Returns the value of the quantity with the given index in the current event
+     * 
+     * The current systematical variation of the reader is taken into account. Throws an exception
+     * if the index is out of range or a cyclic dependency is encountered.
+     */
+    double Get(unsigned index);
+    
+    /// Returns the value of the quantity with the given name in the current event
+    double Get(std::string const &name);
+    
+private:
+    /**
+     * \struct Quantity
+     * \brief Description of a declared quantity
+     */
+    struct Quantity
+    {
+        /// Name of the quantity
+        std::string name;
+        
+        /// Function that computes the quantity
+        Calculator calculator;
+        
+        /// Dependence on systematical variations, including the one inherited from dependencies
+        SystDependence dependence;
+        
+        /// Index of the first cache slot of the quantity
+        unsigned firstSlot;
+        
+        /// Indicates that the quantity is being computed, used to detect cycles
+        bool beingComputed;
+    };
+    
+private:
+    /// Returns the number of cache slots needed for a quantity with the given dependence
+    unsigned GetNumSlots(SystDependence dependence) const noexcept;
+    
+    /// Returns the offset of the cache slot for the current variation
+    unsigned GetSlotOffset(SystDependence dependence) const noexcept;
+    
+private:
+    /// Reader that provides the events
+    Reader &reader;
+    
+    /// Declared quantities
+    std::vector<Quantity> quantities;
+    
+    /// Map from names of the quantities to their indices
+    std::map<std::string, unsigned> indices;
+    
+    /**
+     * \brief Index of the group of variations sharing the same kinematics, for each variation
+     * 
+     * The variations are indexed as in GetAllSystVariations. Group 0 consists of the nominal
+     * configuration and all variations that affect the weight only.
+     */
+    std::vector<unsigned> kinematicGroups;
+    
+    /// Number of groups of variations sharing the same kinematics
+    unsigned nKinematicGroups;
+    
+    /// Cached values for all quantities and variations
+    std::vector<double> values;
+    
+    /// Values of the event counter of the reader at the time the cached values were computed
+    std::vector<unsigned long> stamps;
+};
@@ -0,0 +1,49 @@
+#include <EventBatch.hpp>
+
+#include <Kinematics.hpp>
+
+
+using namespace std;
+
+
+void EventBatch::Clear()
+{
+    lepPt.clear();
+    lepEta.clear();
+    lepPhi.clear();
+    lepIso.clear();
+    lepFlavour.clear();
+    lepOffsets.assign(1, 0);
+    
+    jetPt.clear();
+    jetEta.clear();
+    jetPhi.clear();
+    jetBTag.clear();
+    jetFlavour.clear();
+    jetOffsets.assign(1, 0);
+    
+    metPt.clear();
+    metPhi.clear();
+    nPV.clear();
+    rawWeight.clear();
+}
+
+
+unsigned EventBatch::GetNumEvents() const noexcept
+{
+    return nPV.size();
+}
+
+
+void EventBatch::ComputeJetCartesian(vector<float> &px, vector<float> &py, vector<float> &pz,
+ vector<float> &e) const
+{
+    unsigned const nJets = jetPt.size();
+    px.resize(nJets);
+    py.resize(nJets);
+    pz.resize(nJets);
+    e.resize(nJets);
+    
+    ConvertToCartesian(nJets, jetPt.data(), jetEta.data(), jetPhi.data(), nullptr, px.data(),
+     py.data(), pz.data(), e.data());
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+
+
+/**
+ * \struct EventBatch
+ * \brief A batch of events in columnar form
+ * 
+ * Properties of objects of all events in the batch are stored in contiguous arrays, one per
+ * property (structure of arrays). Objects of event i occupy positions [offsets[i], offsets[i + 1])
+ * in the arrays of the corresponding collection. Within each event the objects are ordered in pt,
+ * in the decreasing order, as in the collections returned by getters of the class Reader.
+ * Per-event properties are stored in arrays indexed with the number of the event in the batch.
+ */
+struct EventBatch
+{
+    /**
+     * \brief Removes all events from the batch, keeping the allocated memory
+     * 
+     * Each vector of offsets is left with a single zero, which requires an allocation the first
+     * time the method is called.
+     */
+    void Clear();
+    
+    /// Returns the number of events in the batch
+    unsigned GetNumEvents() const noexcept;
+    
+    /**
+     * \brief Computes Cartesian components of four-momenta of all jets in the batch
+     * 
+     * The output vectors are resized to the number of jets. Jets are considered massless. The
+     * computation is vectorised, see documentation for the function ConvertToCartesian.
+     */
+    void ComputeJetCartesian(std::vector<float> &px, std::vector<float> &py,
+     std::vector<float> &pz, std::vector<float> &e) const;
+    
+    /// Properties of leptons
+    std::vector<float> lepPt, lepEta, lepPhi, lepIso;
+    
+    /// Flavours of leptons
+    std::vector<int> lepFlavour;
+    
+    /// Offsets of leptons of each event; the size is the number of events plus one
+    std::vector<unsigned> lepOffsets;
+    
+    /// Properties of jets
+    std::vector<float> jetPt, jetEta, jetPhi, jetBTag;
+    
+    /// Flavours of jets
+    std::vector<int> jetFlavour;
+    
+    /// Offsets of jets of each event; the size is the number of events plus one
+    std::vector<unsigned> jetOffsets;
+    
+    /// MET in each event
+    std::vector<float> metPt, metPhi;
+    
+    /// Number of reconstructed primary vertices in each event
+    std::vector<unsigned> nPV;
+    
+    /**
+     * \brief Raw weight of each event as stored in the source tree
+     * 
+     * B-tagging weights are not included.
+     */
+    std::vector<float> rawWeight;
+};
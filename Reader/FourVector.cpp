@@ -0,0 +1,52 @@
+#include <FourVector.hpp>
+
+#include <TLorentzVector.h>
+
+
+FourVector::FourVector() noexcept:
+    pt(0.f), eta(0.f), phi(0.f), mass(0.f)
+{}
+
+
+FourVector::FourVector(double pt_, double eta_, double phi_, double mass_ /*= 0.*/) noexcept:
+    pt(pt_), eta(eta_), phi(phi_), mass(mass_)
+{}
+
+
+FourVector::FourVector(TLorentzVector const &p4) noexcept:
+    pt(p4.Pt()), eta((p4.Pt() > 0.) ? p4.Eta() : 0.), phi(p4.Phi()), mass(p4.M())
+{}
+
+
+void FourVector::Set(double pt_, double eta_, double phi_, double mass_ /*= 0.*/) noexcept
+{
+    pt = pt_;
+    eta = eta_;
+    phi = phi_;
+    mass = mass_;
+}
+
+
+double FourVector::E() const noexcept
+{
+    double const p = double(pt) * std::cosh(eta);
+    return std::sqrt(p * p + double(mass) * mass);
+}
+
+
+double FourVector::DeltaR(FourVector const &rhs) const noexcept
+{
+    double const dEta = eta - rhs.eta;
+    double const dPhi = std::remainder(double(phi) - rhs.phi, 2 * M_PI);
+    
+    return std::sqrt(dEta * dEta + dPhi * dPhi);
+}
+
+
+TLorentzVector FourVector::ToTLorentzVector() const
+{
+    TLorentzVector p4;
+    p4.SetPtEtaPhiM(pt, eta, phi, mass);
+    
+    return p4;
+}
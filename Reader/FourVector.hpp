@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cmath>
+
+
+class TLorentzVector;
+
+
+/**
+ * \class FourVector
+ * \brief A compact four-momentum in (pt, eta, phi, mass) representation
+ * 
+ * The components are stored in single precision, which is sufficient for reconstructed objects
+ * and matches the precision of the source trees. Unlike TLorentzVector, the class is not derived
+ * from TObject and has no virtual methods, so its size is only 16 bytes. Cartesian components are
+ * not stored but are calculated when requested. Trivial accessors are defined in the header so that
+ * they can be inlined, e.g. in comparisons during sorting.
+ */
+class FourVector
+{
+public:
+    /// Constructor with no parameters. All components are set to zero
+    FourVector() noexcept;
+    
+    /// Constructor with explicit initialisation
+    FourVector(double pt, double eta, double phi, double mass = 0.) noexcept;
+    
+    /// Constructor from a TLorentzVector
+    explicit FourVector(TLorentzVector const &p4) noexcept;
+    
+public:
+    /// Updates all components
+    void Set(double pt, double eta, double phi, double mass = 0.) noexcept;
+    
+    /// Transverse momentum
+    float Pt() const noexcept;
+    
+    /// Pseudorapidity
+    float Eta() const noexcept;
+    
+    /// Azimuthal angle
+    float Phi() const noexcept;
+    
+    /// Mass
+    float M() const noexcept;
+    
+    /// Projection of the momentum on the x axis
+    double Px() const noexcept;
+    
+    /// Projection of the momentum on the y axis
+    double Py() const noexcept;
+    
+    /// Projection of the momentum on the z axis
+    double Pz() const noexcept;
+    
+    /// Energy
+    double E() const noexcept;
+    
+    /**
+     * \brief Distance in the (eta, phi) space
+     * 
+     * The difference in phi is wrapped into the range [-pi, pi].
+     */
+    double DeltaR(FourVector const &rhs) const noexcept;
+    
+    /// Converts the four-momentum into a TLorentzVector
+    TLorentzVector ToTLorentzVector() const;
+    
+private:
+    /// Components of the four-momentum
+    float pt, eta, phi, mass;
+};
+
+
+inline float FourVector::Pt() const noexcept
+{
+    return pt;
+}
+
+
+inline float FourVector::Eta() const noexcept
+{
+    return eta;
+}
+
+
+inline float FourVector::Phi() const noexcept
+{
+    return phi;
+}
+
+
+inline float FourVector::M() const noexcept
+{
+    return mass;
+}
+
+
+inline double FourVector::Px() const noexcept
+{
+    return pt * std::cos(phi);
+}
+
+
+inline double FourVector::Py() const noexcept
+{
+    return pt * std::sin(phi);
+}
+
+
+inline double FourVector::Pz() const noexcept
+{
+    return pt * std::sinh(eta);
+}
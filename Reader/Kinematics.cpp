@@ -0,0 +1,410 @@
+#include <Kinematics.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+
+// Builds of the kernel for specific instruction sets are only provided for x86 with compilers
+//that support function-level targets and detection of features of the processor
+#if defined(__GNUC__) and (defined(__x86_64__) or defined(__i386__))
+    #define KINEMATICS_MULTIVERSION
+#endif
+
+
+#ifdef __GNUC__
+    #define KINEMATICS_INLINE inline __attribute__((always_inline))
+#else
+    #define KINEMATICS_INLINE inline
+#endif
+
+
+using namespace std;
+
+
+/**
+ * \brief Reinterprets the binary representation of a single-precision number as an integer
+ * 
+ * Comparisons and selections in the kernels are performed on integer representations of
+ * floating-point numbers. Unlike their floating-point counterparts, they cannot raise exceptions,
+ * and thus the compiler is free to convert them into branch-free code and vectorise the loops.
+ */
+static KINEMATICS_INLINE int32_t ToBits(float x) noexcept
+{
+    union
+    {
+        float f;
+        int32_t i;
+    } bits;
+    
+    bits.f = x;
+    return bits.i;
+}
+
+
+/// Reinterprets an integer as the binary representation of a single-precision number
+static KINEMATICS_INLINE float FromBits(int32_t i) noexcept
+{
+    union
+    {
+        int32_t i;
+        float f;
+    } bits;
+    
+    bits.i = i;
+    return bits.f;
+}
+
+
+/// Returns a if the condition is true and b otherwise, without branching
+static KINEMATICS_INLINE float Select(bool condition, float a, float b) noexcept
+{
+    int32_t const mask = -int32_t(condition);
+    return FromBits((ToBits(a) & mask) | (ToBits(b) & ~mask));
+}
+
+
+/// Checks if the absolute value of x is smaller than that of y; both must not be NaN
+static KINEMATICS_INLINE bool AbsLess(float x, float y) noexcept
+{
+    return ((ToBits(x) & 0x7FFFFFFF) < (ToBits(y) & 0x7FFFFFFF));
+}
+
+
+/// Calculates 2^n for an integer n in the range of normal single-precision numbers
+static KINEMATICS_INLINE float Pow2(int32_t n) noexcept
+{
+    return FromBits((n + 127) << 23);
+}
+
+
+/// Rounds a number to the nearest integer, with halfway cases rounded away from zero
+static KINEMATICS_INLINE int32_t Round(float x) noexcept
+{
+    return int32_t(x + copysign(0.5f, x));
+}
+
+
+/**
+ * \brief Calculates sine and cosine of an angle
+ * 
+ * The angle is reduced to the range [-pi/4, pi/4] by subtracting a multiple of pi/2, and the
+ * functions are approximated with polynomials in this range. The coefficients are borrowed from
+ * the Cephes library. The result is accurate for angles not much larger than pi in absolute value.
+ */
+static KINEMATICS_INLINE void SinCos(float x, float &sinX, float &cosX) noexcept
+{
+    // Find the quadrant and reduce the angle. The multiple of pi/2 is subtracted in three parts to
+    //preserve precision
+    int32_t const q = Round(x * 0.63661977f);
+    float const qf = float(q);
+    float const r = ((x - qf * 1.5703125f) - qf * 4.837512969970703125e-4f) -
+     qf * 7.54978995489188216e-8f;
+    float const z = r * r;
+    
+    
+    // Polynomial approximations in the reduced range
+    float const s = r + r * z * (-1.6666654611e-1f + z * (8.3321608736e-3f +
+     z * -1.9515295891e-4f));
+    float const c = 1.f - 0.5f * z + z * z * (4.166664568298827e-2f +
+     z * (-1.388731625493765e-3f + z * 2.443315711809948e-5f));
+    
+    
+    // Choose the function and the sign according to the quadrant. The sign is flipped by setting
+    //the sign bit. The shift is performed on unsigned numbers since shifting a bit into the sign
+    //position of a signed one is undefined
+    bool const swap = (q & 1);
+    uint32_t const sinSign = uint32_t(q & 2) << 30;
+    uint32_t const cosSign = uint32_t((q + 1) & 2) << 30;
+    sinX = FromBits(int32_t(uint32_t(ToBits(Select(swap, c, s))) ^ sinSign));
+    cosX = FromBits(int32_t(uint32_t(ToBits(Select(swap, s, c))) ^ cosSign));
+}
+
+
+/**
+ * \brief Calculates hyperbolic sine and cosine
+ * 
+ * The exponent is evaluated by reducing the argument to the range [-ln(2)/2, ln(2)/2] and using a
+ * polynomial approximation from the Cephes library. For small arguments the hyperbolic sine is
+ * evaluated with a Taylor series to avoid the cancellation. The argument must not exceed 80 in
+ * absolute value.
+ */
+static KINEMATICS_INLINE void SinhCosh(float x, float &sinhX, float &coshX) noexcept
+{
+    // The exponent
+    int32_t const n = Round(x * 1.44269504f);
+    float const nf = float(n);
+    float const r = (x - nf * 0.693359375f) - nf * -2.12194440e-4f;
+    float const p = ((((((1.9875691500e-4f * r + 1.3981999507e-3f) * r + 8.3334519073e-3f) * r +
+     4.1665795894e-2f) * r + 1.6666665459e-1f) * r + 5.0000001201e-1f) * r * r + r + 1.f) *
+     Pow2(n);
+    float const pInv = 1.f / p;
+    
+    
+    // Hyperbolic functions
+    float const x2 = x * x;
+    float const sinhSeries = x * (1.f + x2 * (1.6666667e-1f + x2 * (8.3333333e-3f +
+     x2 * 1.9841270e-4f)));
+    
+    sinhX = Select(AbsLess(x, 0.5f), sinhSeries, 0.5f * (p - pInv));
+    coshX = 0.5f * (p + pInv);
+}
+
+
+/**
+ * \brief Body of the conversion kernel
+ * 
+ * It is inlined into all builds of the kernel so that each of them is vectorised for its own
+ * instruction set.
+ */
+template<bool hasMass>
+static KINEMATICS_INLINE void ConvertKernel(unsigned n, float const *__restrict__ pt,
+ float const *__restrict__ eta, float const *__restrict__ phi, float const *__restrict__ mass,
+ float *__restrict__ px, float *__restrict__ py, float *__restrict__ pz, float *__restrict__ e)
+ noexcept
+{
+    for (unsigned i = 0; i < n; ++i)
+    {
+        float sinPhi, cosPhi, sinhEta, coshEta;
+        float const etaClipped = Select(AbsLess(eta[i], 20.f), eta[i], copysign(20.f, eta[i]));
+        
+        SinCos(phi[i], sinPhi, cosPhi);
+        SinhCosh(etaClipped, sinhEta, coshEta);
+        
+        float const p = pt[i] * coshEta;
+        float const m = (hasMass) ? mass[i] : 0.f;
+        
+        px[i] = pt[i] * cosPhi;
+        py[i] = pt[i] * sinPhi;
+        pz[i] = pt[i] * sinhEta;
+        e[i] = sqrt(p * p + m * m);
+    }
+}
+
+
+/**
+ * \brief Body of the kernel for the matrix of DeltaR
+ * 
+ * The inner loop runs over the second collection and is vectorised. The difference in phi is
+ * wrapped into the range [-pi, pi] without branches by subtracting the nearest multiple of 2 pi.
+ */
+static KINEMATICS_INLINE void DeltaRMatrixKernel(unsigned n1, float const *__restrict__ eta1,
+ float const *__restrict__ phi1, unsigned n2, float const *__restrict__ eta2,
+ float const *__restrict__ phi2, float *__restrict__ deltaR) noexcept
+{
+    for (unsigned i = 0; i < n1; ++i)
+    {
+        float const eta = eta1[i];
+        float const phi = phi1[i];
+        float *__restrict__ row = deltaR + i * n2;
+        
+        for (unsigned j = 0; j < n2; ++j)
+        {
+            float const dEta = eta - eta2[j];
+            float dPhi = phi - phi2[j];
+            dPhi -= 6.2831853f * float(Round(dPhi * 0.15915494f));
+            row[j] = sqrt(dEta * dEta + dPhi * dPhi);
+        }
+    }
+}
+
+
+/**
+ * \brief Body of the kernel to find nearest neighbours
+ * 
+ * Squared distances from an object of the first collection to a block of objects of the second
+ * collection are computed in a vectorised loop and stored in a small buffer on the stack, which
+ * is then scanned for the minimum.
+ */
+static KINEMATICS_INLINE void FindNearestKernel(unsigned n1, float const *__restrict__ eta1,
+ float const *__restrict__ phi1, unsigned n2, float const *__restrict__ eta2,
+ float const *__restrict__ phi2, int *__restrict__ indices, float *__restrict__ deltaR) noexcept
+{
+    unsigned const blockSize = 64;
+    float dR2[blockSize];
+    
+    for (unsigned i = 0; i < n1; ++i)
+    {
+        float const eta = eta1[i];
+        float const phi = phi1[i];
+        int nearest = -1;
+        float minDR2 = 0.f;
+        
+        for (unsigned start = 0; start < n2; start += blockSize)
+        {
+            unsigned const end = (n2 - start > blockSize) ? start + blockSize : n2;
+            
+            for (unsigned j = start; j < end; ++j)
+            {
+                float const dEta = eta - eta2[j];
+                float dPhi = phi - phi2[j];
+                dPhi -= 6.2831853f * float(Round(dPhi * 0.15915494f));
+                dR2[j - start] = dEta * dEta + dPhi * dPhi;
+            }
+            
+            for (unsigned j = start; j < end; ++j)
+            {
+                if (nearest == -1 or dR2[j - start] < minDR2)
+                {
+                    nearest = j;
+                    minDR2 = dR2[j - start];
+                }
+            }
+        }
+        
+        indices[i] = nearest;
+        deltaR[i] = (nearest == -1) ? -1.f : sqrt(minDR2);
+    }
+}
+
+
+// Builds of all kernels for the given instruction set. The suffix is appended to names of the
+//functions, and the attributes are applied to them
+#define KINEMATICS_DEFINE_BUILD(suffix, attributes) \
+    attributes static void Convert##suffix(unsigned n, float const *pt, float const *eta, \
+     float const *phi, float const *mass, float *px, float *py, float *pz, float *e) \
+    { \
+        if (mass) \
+            ConvertKernel<true>(n, pt, eta, phi, mass, px, py, pz, e); \
+        else \
+            ConvertKernel<false>(n, pt, eta, phi, mass, px, py, pz, e); \
+    } \
+    \
+    attributes static void DeltaRMatrix##suffix(unsigned n1, float const *eta1, \
+     float const *phi1, unsigned n2, float const *eta2, float const *phi2, float *deltaR) \
+    { \
+        DeltaRMatrixKernel(n1, eta1, phi1, n2, eta2, phi2, deltaR); \
+    } \
+    \
+    attributes static void FindNearest##suffix(unsigned n1, float const *eta1, \
+     float const *phi1, unsigned n2, float const *eta2, float const *phi2, int *indices, \
+     float *deltaR) \
+    { \
+        FindNearestKernel(n1, eta1, phi1, n2, eta2, phi2, indices, deltaR); \
+    }
+
+
+KINEMATICS_DEFINE_BUILD(Default, )
+
+#ifdef KINEMATICS_MULTIVERSION
+KINEMATICS_DEFINE_BUILD(SSE41, __attribute__((target("sse4.1"))))
+KINEMATICS_DEFINE_BUILD(AVX2, __attribute__((target("avx2"))))
+#endif
+
+
+/**
+ * \struct KernelChoice
+ * \brief Builds of the kernels chosen for the current processor
+ */
+struct KernelChoice
+{
+    /// Name of the instruction set
+    char const *name;
+    
+    /// Conversion into Cartesian components
+    void (*convert)(unsigned, float const *, float const *, float const *, float const *,
+     float *, float *, float *, float *);
+    
+    /// Matrix of DeltaR
+    void (*deltaRMatrix)(unsigned, float const *, float const *, unsigned, float const *,
+     float const *, float *);
+    
+    /// Nearest neighbours
+    void (*findNearest)(unsigned, float const *, float const *, unsigned, float const *,
+     float const *, int *, float *);
+};
+
+
+/// Available builds of the kernels, starting from the most capable one
+static KernelChoice const kernelBuilds[] =
+{
+    #ifdef KINEMATICS_MULTIVERSION
+    {"avx2", ConvertAVX2, DeltaRMatrixAVX2, FindNearestAVX2},
+    {"sse4.1", ConvertSSE41, DeltaRMatrixSSE41, FindNearestSSE41},
+    #endif
+    {"default", ConvertDefault, DeltaRMatrixDefault, FindNearestDefault}
+};
+
+
+/// Checks if the processor supports the instruction set targeted by the given build
+static bool IsSupported(KernelChoice const &build) noexcept
+{
+    #ifdef KINEMATICS_MULTIVERSION
+    __builtin_cpu_init();
+    
+    if (strcmp(build.name, "avx2") == 0)
+        return __builtin_cpu_supports("avx2");
+    
+    if (strcmp(build.name, "sse4.1") == 0)
+        return __builtin_cpu_supports("sse4.1");
+    #endif
+    
+    return true;
+}
+
+
+/**
+ * \brief Returns the builds of the kernels in use
+ * 
+ * Initially, the most capable builds supported by the processor are chosen. The choice can be
+ * overridden with SetKinematicsKernel.
+ */
+static atomic<KernelChoice const *> &CurrentKernel() noexcept
+{
+    static atomic<KernelChoice const *> current(find_if(begin(kernelBuilds), end(kernelBuilds),
+     IsSupported));
+    
+    return current;
+}
+
+
+/// Returns the builds of the kernels in use
+static KINEMATICS_INLINE KernelChoice const &ChooseKernel() noexcept
+{
+    return *CurrentKernel().load(memory_order_relaxed);
+}
+
+
+void ConvertToCartesian(unsigned n, float const *pt, float const *eta, float const *phi,
+ float const *mass, float *px, float *py, float *pz, float *e) noexcept
+{
+    ChooseKernel().convert(n, pt, eta, phi, mass, px, py, pz, e);
+}
+
+
+void ComputeDeltaRMatrix(unsigned n1, float const *eta1, float const *phi1, unsigned n2,
+ float const *eta2, float const *phi2, float *deltaR) noexcept
+{
+    ChooseKernel().deltaRMatrix(n1, eta1, phi1, n2, eta2, phi2, deltaR);
+}
+
+
+void FindNearest(unsigned n1, float const *eta1, float const *phi1, unsigned n2,
+ float const *eta2, float const *phi2, int *indices, float *deltaR) noexcept
+{
+    ChooseKernel().findNearest(n1, eta1, phi1, n2, eta2, phi2, indices, deltaR);
+}
+
+
+char const *GetKinematicsKernelName() noexcept
+{
+    return ChooseKernel().name;
+}
+
+
+bool SetKinematicsKernel(char const *name) noexcept
+{
+    for (auto const &build: kernelBuilds)
+    {
+        if (strcmp(build.name, name) == 0 and IsSupported(build))
+        {
+            CurrentKernel().store(&build, memory_order_relaxed);
+            return true;
+        }
+    }
+    
+    return false;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+
+/**
+ * \brief Converts four-momenta of a number of objects from (pt, eta, phi, mass) into Cartesian
+ * components
+ * 
+ * The input and output arrays must hold n elements each and must not overlap. If the array of
+ * masses is null, the objects are considered massless. Pseudorapidities are clipped to the range
+ * [-20, 20].
+ * 
+ * The conversion is performed by a kernel that evaluates the trigonometric and hyperbolic functions
+ * with polynomial approximations and is written to be vectorised by the compiler. Its relative
+ * accuracy is at the level of 1e-6. Several builds of the kernel are included, targeting AVX2,
+ * SSE4.1, and the baseline instruction set (SSE2 on x86-64 or scalar code on other platforms). The
+ * most capable one supported by the processor is chosen at the first call.
+ */
+void ConvertToCartesian(unsigned n, float const *pt, float const *eta, float const *phi,
+ float const *mass, float *px, float *py, float *pz, float *e) noexcept;
+
+
+/**
+ * \brief Computes the matrix of distances in the (eta, phi) space between objects of two
+ * collections
+ * 
+ * The distance between object i of the first collection and object j of the second one is written
+ * to deltaR[i * n2 + j]. The difference in phi is wrapped into the range [-pi, pi]. The output
+ * array must not overlap the input ones. The computation is vectorised as in ConvertToCartesian.
+ */
+void ComputeDeltaRMatrix(unsigned n1, float const *eta1, float const *phi1, unsigned n2,
+ float const *eta2, float const *phi2, float *deltaR) noexcept;
+
+
+/**
+ * \brief Finds nearest neighbours in the (eta, phi) space
+ * 
+ * For each object i of the first collection, the index of the closest object of the second
+ * collection is written to indices[i], and the distance to it is written to deltaR[i]. If the
+ * second collection is empty, the index and the distance are set to -1. Ties are resolved in
+ * favour of the smaller index. The output arrays must not overlap the input ones.
+ */
+void FindNearest(unsigned n1, float const *eta1, float const *phi1, unsigned n2,
+ float const *eta2, float const *phi2, int *indices, float *deltaR) noexcept;
+
+
+/**
+ * \brief Returns the name of the instruction set targeted by the kernels in use
+ * 
+ * Possible values are "avx2", "sse4.1", and "default".
+ */
+char const *GetKinematicsKernelName() noexcept;
+
+
+/**
+ * \brief Forces the use of the builds of the kernels targeting the given instruction set
+ * 
+ * Accepts the same names as returned by GetKinematicsKernelName. Returns false and keeps the
+ * current choice if the builds are not included or the processor does not support the instruction
+ * set. Intended for tests; must not be called concurrently with the kernels.
+ */
+bool SetKinematicsKernel(char const *name) noexcept;
@@ -11,15 +11,14 @@ Candidate::Candidate(TLorentzVector const &p4_) noexcept:
 {}
 
 
-Candidate::Candidate(double pt, double eta, double phi, double mass /*= 0.*/) noexcept
-{
-    p4.SetPtEtaPhiM(pt, eta, phi, mass);
-}
+Candidate::Candidate(double pt, double eta, double phi, double mass /*= 0.*/) noexcept:
+    p4(pt, eta, phi, mass)
+{}
 
 
-TLorentzVector const &Candidate::P4() const noexcept
+TLorentzVector Candidate::P4() const
 {
-    return p4;
+    return p4.ToTLorentzVector();
 }
 
 
@@ -47,6 +46,30 @@ double Candidate::M() const noexcept
 }
 
 
+double Candidate::Px() const noexcept
+{
+    return p4.Px();
+}
+
+
+double Candidate::Py() const noexcept
+{
+    return p4.Py();
+}
+
+
+double Candidate::Pz() const noexcept
+{
+    return p4.Pz();
+}
+
+
+double Candidate::E() const noexcept
+{
+    return p4.E();
+}
+
+
 double Candidate::DeltaR(Candidate const &rhs) const noexcept
 {
     return p4.DeltaR(rhs.p4);
@@ -67,29 +90,27 @@ Lepton::Lepton() noexcept:
 
 
 Lepton::Lepton(int flavour_, double pt, double eta, double phi, double isolation_) noexcept:
+    Candidate(pt, eta, phi, GetMass(flavour_)),
     flavour(flavour_), isolation(isolation_)
+{}
+
+
+double Lepton::GetMass(int flavour) noexcept
 {
-    // Deduce the mass
-    double mass = 0.;
-    
     switch (abs(flavour))
     {
         case 11:  // electron
-            mass = 0.511e-3;
-            break;
+            return 0.511e-3;
         
         case 13:  // muon
-            mass = 105.7e-3;
-            break;
+            return 105.7e-3;
         
         case 15:  // tau-lepton
-            mass = 1776.8e-3;
-            break;
+            return 1776.8e-3;
+        
+        default:
+            return 0.;
     }
-    
-    
-    // Set the four-momentum
-    Candidate::p4.SetPtEtaPhiM(pt, eta, phi, mass);
 }
 
 
@@ -143,5 +164,5 @@ MET::MET(double pt, double phi) noexcept:
 
 void MET::Set(double pt, double phi) noexcept
 {
-    Candidate::p4.SetPtEtaPhiM(pt, 0., phi, 0.);
+    Candidate::p4.Set(pt, 0., phi, 0.);
 }
@@ -1,13 +1,16 @@
 #pragma once
 
+#include <FourVector.hpp>
+
 #include <TLorentzVector.h>
 
 
 /**
  * \class Candidate
- * \brief A wrapper around a Lorentz vector
+ * \brief A wrapper around a four-momentum
  * 
- * The class is used as a base class for leptons and jets
+ * The class is used as a base class for leptons and jets. The four-momentum is stored in a compact
+ * (pt, eta, phi, mass) representation, see documentation for the class FourVector.
  */
 class Candidate
 {
@@ -22,8 +25,13 @@ public:
     Candidate(double pt, double eta, double phi, double mass = 0.) noexcept;
     
 public:
-    /// Accessor to the four-momentum
-    TLorentzVector const &P4() const noexcept;
+    /**
+     * \brief Returns the four-momentum as a TLorentzVector
+     * 
+     * The vector is constructed on each call. Use the short-cuts below when only individual
+     * components are needed.
+     */
+    TLorentzVector P4() const;
     
     /// A short-cut for transverse momentum
     double Pt() const noexcept;
@@ -37,6 +45,18 @@ public:
     /// A short-cut for mass
     double M() const noexcept;
     
+    /// A short-cut for projection of the momentum on the x axis
+    double Px() const noexcept;
+    
+    /// A short-cut for projection of the momentum on the y axis
+    double Py() const noexcept;
+    
+    /// A short-cut for projection of the momentum on the z axis
+    double Pz() const noexcept;
+    
+    /// A short-cut for energy
+    double E() const noexcept;
+    
     /// A short-cut to calculate dR distance
     double DeltaR(Candidate const &rhs) const noexcept;
     
@@ -45,7 +65,7 @@ public:
     
 protected:
     /// Four-momentum
-    TLorentzVector p4;
+    FourVector p4;
 };
 
 
@@ -82,6 +102,13 @@ public:
      */
     double Isolation() const noexcept;
     
+    /**
+     * \brief Returns mass of a lepton of the given flavour
+     * 
+     * The flavour is encoded with PDG ID codes. Zero is returned for unknown flavours.
+     */
+    static double GetMass(int flavour) noexcept;
+    
 private:
     /**
      * \brief Flavour
@@ -91,7 +118,7 @@ private:
     int flavour;
     
     /// Isolation
-    double isolation;
+    float isolation;
 };
 
 
@@ -143,7 +170,7 @@ private:
      * 
      * See documentation for the method 'BTag'.
      */
-    double bTag;
+    float bTag;
 };
 
 
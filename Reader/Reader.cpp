@@ -1,119 +1,379 @@
 #include <Reader.hpp>
 
+#include <TLeaf.h>
+#include <TTreeCache.h>
+
 #include <stdexcept>
 #include <sstream>
 #include <algorithm>
+#include <iomanip>
+#include <limits>
 
 
 using namespace std;
 
 
-// A static data member
-unsigned const Reader::maxSize;
+/**
+ * \brief Finds order of objects in the decreasing pt
+ * 
+ * The order is written as a permutation of indices of the objects. Sorting is skipped if the
+ * objects are already ordered.
+ */
+static void OrderInPt(Float_t const *pt, int size, vector<unsigned> &order)
+{
+    order.resize(size);
+    
+    for (int i = 0; i < size; ++i)
+        order[i] = i;
+    
+    if (not is_sorted(pt, pt + size, greater<Float_t>()))
+        stable_sort(order.begin(), order.end(),
+         [pt](unsigned i, unsigned j){return pt[i] > pt[j];});
+}
+
+
+/// Appends elements of the source array to the vector in the given order
+template<typename T>
+static void AppendOrdered(vector<T> &dst, T const *src, vector<unsigned> const &order)
+{
+    for (auto const &i: order)
+        dst.push_back(src[i]);
+}
+
+
+ostream &operator<<(ostream &out, IOStats const &stats)
+{
+    ostringstream ost;
+    ost << "Tree \"" << stats.treeName << "\": " << stats.readCalls << " read calls, " <<
+     fixed << setprecision(1) << stats.bytesRead / 1048576. << " MiB read";
+    
+    return (out << ost.str());
+}
 
 
-Reader::Reader(shared_ptr<TFile> &srcFile_, list<string> const &treeNames_, bool isMC_ /*= true*/):
-    srcFile(srcFile_), treeNames(treeNames_), curTreeNameIt(treeNames.begin()), isMC(isMC_),
-    curSystType(SystType::Nominal), curSystDirection(SystDirection::Up),
-    applyBTagReweighting(true)
+Reader::Reader(shared_ptr<TFile> &srcFile_, list<string> const &treeNames_, bool isMC_ /*= true*/,
+ shared_ptr<CSVReweighter const> csvReweighter_ /*= nullptr*/):
+    srcFile(srcFile_), treeNames(treeNames_), csvReweighter(csvReweighter_),
+    curTreeNameIt(treeNames.begin()),
+    cacheSize(10 * 1024 * 1024), asyncPrefetch(false),
+    ioStatsPending(false), entryRange{0, numeric_limits<unsigned long>::max()}, curTreeOffset(0),
+    isMC(isMC_),
+    activeCollections(~0u), curSystType(SystType::Nominal), curSystDirection(SystDirection::Up),
+    nReadAheadBuffers(0), producerFinished(false), stopReadAhead(false), curEvent(&directEvent),
+    eventCounter(0), applyBTagReweighting(true), skimFile(nullptr), skimWeightComponents(false)
 {
     // Make sure the source file is a valid one
     if (not srcFile or srcFile->IsZombie())
         throw runtime_error("The source file does not exist or is corrupted.");
     
     
+    // Reweighting for b-tagging is only needed for simulation
+    if (not isMC)
+        csvReweighter.reset();
+    else if (not csvReweighter)
+        csvReweighter = CSVReweighter::GetDefault();
+    
+    
+    // Allocate the cache of event weights. No weight is up-to-date initially
+    unsigned const nVariations = GetAllSystVariations().size();
+    cachedWeights.resize(nVariations);
+    cachedWeightStamps.assign(nVariations, numeric_limits<unsigned long>::max());
+    
+    
     // Get the first tree
     GetTree(*curTreeNameIt);
 }
 
 
-Reader::Reader(shared_ptr<TFile> &srcFile_, string const &treeName, bool isMC_ /*= true*/):
-    Reader(srcFile_, list<string>{treeName}, isMC_)
+Reader::Reader(shared_ptr<TFile> &srcFile_, string const &treeName, bool isMC_ /*= true*/,
+ shared_ptr<CSVReweighter const> csvReweighter_ /*= nullptr*/):
+    Reader(srcFile_, list<string>{treeName}, isMC_, csvReweighter_)
 {}
 
 
+Reader::~Reader() noexcept
+{
+    StopReadAhead();
+}
+
+
+void Reader::Event::Clear() noexcept
+{
+    leptons.clear();
+    jets.clear();
+    jetsJECUp.clear();
+    jetsJECDown.clear();
+    
+    met = metJECUp = metJECDown = MET();
+    jecCollectionsBuilt = true;
+    nPV = 0;
+    rawWeight = 1.;
+}
+
+
 bool Reader::ReadNextEvent()
 {
-    // Check if there are events left in the current source tree
-    if (curEntry == nEntries)  // no more events in the current tree
-    {
-        ++curTreeNameIt;
-        
-        if (curTreeNameIt == treeNames.end())  // no more source trees
-            return false;
-        
-        GetTree(*curTreeNameIt);
-    }
+    // In the read-ahead mode events are read and unpacked by a background thread
+    if (nReadAheadBuffers > 0)
+        return TakeReadAheadEvent();
     
     
-    // Either there were events in the current source file or a new file has been opened
-    curTree->GetEntry(curEntry);
-    ++curEntry;
+    // Otherwise read the event in this thread
+    if (not ReadEntry())
+        return false;
     
+    UnpackEvent();
+    curEvent = &directEvent;
     
-    // Copy properies of objects in the event from read buffers
-    leptons.clear();
     
-    for (int i = 0; i < lepSize; ++i)
-        leptons.emplace_back(lepFlavour[i], lepPt[i], lepEta[i], lepPhi[i], lepIso[i]);
+    // Change the counter so that the cached weights are no longer up-to-date
+    ++eventCounter;
     
-    jets.clear();
     
-    for (int i = 0; i < jetSize; ++i)
-        jets.emplace_back(jetPt[i], jetEta[i], jetPhi[i], jetBTag[i], jetFlavour[i]);
+    return true;
+}
+
+
+EventBatch const &Reader::ReadNextBatch(unsigned maxEvents)
+{
+    if (nReadAheadBuffers > 0)
+        throw logic_error("Batches of events cannot be read in the read-ahead mode.");
+    
+    batch.Clear();
     
-    met.Set(metPt, metPhi);
     
-    if (isMC)
+    // Choose buffers for jets and MET according to the systematical variation in effect
+    bool const useJEC = (isMC and curSystType == SystType::JEC);
+    bool const up = (curSystDirection == SystDirection::Up);
+    
+    Int_t const &jSize = (useJEC) ? ((up) ? jetJECUpSize : jetJECDownSize) : jetSize;
+    JetCollection const &jets = (useJEC) ?
+     ((up) ? directEvent.jetsJECUp : directEvent.jetsJECDown) : directEvent.jets;
+    LeptonCollection const &leptons = directEvent.leptons;
+    Float_t const &mPt = (useJEC) ? ((up) ? metJECUpPt : metJECDownPt) : metPt;
+    Float_t const &mPhi = (useJEC) ? ((up) ? metJECUpPhi : metJECDownPhi) : metPhi;
+    
+    
+    // Read events and copy properties of objects, ordering them in pt
+    while (batch.GetNumEvents() < maxEvents and ReadEntry())
     {
-        jetsJECUp.clear();
-        jetsJECDown.clear();
+        if (useJEC)
+            for (auto &b: jecBranches)
+                b->GetEntry(curEntry - 1);
         
-        for (int i = 0; i < jetJECUpSize; ++i)
-            jetsJECUp.emplace_back(jetJECUpPt[i], jetJECUpEta[i], jetJECUpPhi[i],
-             jetJECUpBTag[i], jetJECUpFlavour[i]);
+        OrderInPt(leptons.PtArray(), lepSize, batchOrder);
+        AppendOrdered(batch.lepPt, leptons.PtArray(), batchOrder);
+        AppendOrdered(batch.lepEta, leptons.EtaArray(), batchOrder);
+        AppendOrdered(batch.lepPhi, leptons.PhiArray(), batchOrder);
+        AppendOrdered(batch.lepIso, leptons.IsolationArray(), batchOrder);
+        AppendOrdered(batch.lepFlavour, leptons.FlavourArray(), batchOrder);
+        batch.lepOffsets.push_back(batch.lepPt.size());
         
-        for (int i = 0; i < jetJECDownSize; ++i)
-            jetsJECDown.emplace_back(jetJECDownPt[i], jetJECDownEta[i], jetJECDownPhi[i],
-             jetJECDownBTag[i], jetJECDownFlavour[i]);
+        OrderInPt(jets.PtArray(), jSize, batchOrder);
+        AppendOrdered(batch.jetPt, jets.PtArray(), batchOrder);
+        AppendOrdered(batch.jetEta, jets.EtaArray(), batchOrder);
+        AppendOrdered(batch.jetPhi, jets.PhiArray(), batchOrder);
+        AppendOrdered(batch.jetBTag, jets.BTagArray(), batchOrder);
+        AppendOrdered(batch.jetFlavour, jets.FlavourArray(), batchOrder);
+        batch.jetOffsets.push_back(batch.jetPt.size());
         
-        metJECUp.Set(metJECUpPt, metJECUpPhi);
-        metJECDown.Set(metJECDownPt, metJECDownPhi);
+        batch.metPt.push_back(mPt);
+        batch.metPhi.push_back(mPhi);
+        batch.nPV.push_back(nPV);
+        batch.rawWeight.push_back(rawWeight);
     }
     
     
-    // Make sure vector of leptons and jets are ordered in pt
-    sort(leptons.rbegin(), leptons.rend());
-    sort(jets.rbegin(), jets.rend());
+    // The read buffers, which are shared with collections of the current event, have been
+    //overwritten, including the ones affected by JEC variations. Reset the event so that getters
+    //do not mix stale and new properties, and invalidate cached weights
+    directEvent.Clear();
+    ++eventCounter;
     
-    if (isMC)
+    
+    return batch;
+}
+
+
+unsigned long Reader::Skim(TFile &outFile, function<bool(Reader &)> const &predicate,
+ bool writeWeightComponents /*= false*/)
+{
+    if (nReadAheadBuffers > 0)
+        throw logic_error("Skims cannot be produced in the read-ahead mode.");
+    
+    
+    // Start from the beginning. Copies of the source trees are created and written when the trees
+    //are opened and closed
+    skimFile = &outFile;
+    skimWeightComponents = (writeWeightComponents and isMC and IsActive(Collection::Weight));
+    Rewind();
+    
+    unsigned long nWritten = 0;
+    
+    try
+    {
+        while (ReadNextEvent())
+        {
+            if (not predicate(*this))
+                continue;
+            
+            
+            // Branches affected by JEC variations are read on demand. Make sure they are
+            //up-to-date before the event is written
+            BuildJECCollections(*curEvent);
+            
+            
+            // Evaluate components of the weight. The buffers have been allocated for the largest
+            //possible number of jets, so that they are not reallocated here
+            if (skimWeightComponents)
+            {
+                GetBTagWeights(skimBTagWeights);
+                GetJetBTagWeights(skimJetBTagWeights);
+            }
+            
+            skimTree->Fill();
+            ++nWritten;
+        }
+    }
+    catch (...)
     {
-        sort(jetsJECUp.rbegin(), jetsJECUp.rend());
-        sort(jetsJECDown.rbegin(), jetsJECDown.rend());
+        skimTree.reset();
+        skimFile = nullptr;
+        skimWeightComponents = false;
+        throw;
     }
     
+    WriteSkimTree();
+    skimFile = nullptr;
+    skimWeightComponents = false;
     
-    // Indicate that the stored event weight is no longer up-to-date
-    weightCached = false;
-        
     
-    return true;
+    return nWritten;
 }
 
 
-void Reader::Rewind() noexcept
+void Reader::Rewind()
 {
-    curTreeNameIt = treeNames.begin();
+    StopReadAhead();
+    
     
-    // Delete the current tree. It must be done during the rewind because if there is only single
-    //tree in the sample, the GetTree will try to reset curTree to the same pointer, and it will
-    //lead to a segfault
+    // Find the tree that contains the first entry of the requested range, so that preceding trees
+    //contribute neither to input statistics nor to the skim. To find it, each tree is opened once,
+    //when the first such range is set, to count its entries
+    auto treeNameIt = treeNames.begin();
+    unsigned long treeOffset = 0;
+    
+    if (entryRange.begin > 0)
+    {
+        if (treeSizes.empty())
+            for (auto const &name: treeNames)
+                treeSizes.push_back(CountEntries(*srcFile, {name}));
+        
+        auto sizeIt = treeSizes.cbegin();
+        
+        while (next(treeNameIt) != treeNames.end() and treeOffset + *sizeIt <= entryRange.begin)
+        {
+            treeOffset += *sizeIt;
+            ++sizeIt;
+            ++treeNameIt;
+        }
+    }
+    
+    
+    // If the tree is loaded already, only update the range of entries to be read in it. This is
+    //the common case when consecutive ranges of the same tree are read one after another, and the
+    //tree and its cache need not be rebuilt. It is not possible when a skim is being started since
+    //the tree must be copied into the output file
+    if (curTree and treeNameIt == curTreeNameIt and not skimFile)
+    {
+        RecordIOStats();
+        SetUpEntryRange();
+        
+        if (cacheSize > 0)
+            curTree->SetCacheEntryRange(curEntry, nEntries);
+        
+        return;
+    }
+    
+    
+    // Otherwise delete the current tree. It must be done during the rewind because if there is
+    //only single tree in the sample, the GetTree will try to reset curTree to the same pointer, and
+    //it will lead to a segfault
+    RecordIOStats();
+    WriteSkimTree();
     curTree.reset();
     
+    curTreeNameIt = treeNameIt;
+    curTreeOffset = treeOffset;
     GetTree(*curTreeNameIt);
 }
 
 
+void Reader::SetEntryRange(EntryRange const &range)
+{
+    entryRange = range;
+    Rewind();
+}
+
+
+void Reader::SetReadAhead(unsigned nBuffers)
+{
+    StopReadAhead();
+    
+    nReadAheadBuffers = nBuffers;
+    readAheadEvents.resize(nBuffers);
+}
+
+
+void Reader::SetCollections(initializer_list<Collection> const &collections)
+{
+    CheckNoReadAhead();
+    
+    activeCollections = 0;
+    
+    for (auto const &c: collections)
+        activeCollections |= (1u << unsigned(c));
+    
+    
+    // Update buffers of the current tree
+    SetUpBranches();
+}
+
+
+void Reader::SetPreselection(function<bool(Multiplicities const &)> const &preselection_)
+{
+    CheckNoReadAhead();
+    preselection = preselection_;
+}
+
+
+void Reader::SetCacheSize(Long64_t cacheSize_)
+{
+    CheckNoReadAhead();
+    cacheSize = cacheSize_;
+    SetUpCache();
+}
+
+
+void Reader::SwitchAsyncPrefetch(bool on /*= true*/)
+{
+    asyncPrefetch = on;
+}
+
+
+vector<IOStats> const &Reader::GetIOStats() const noexcept
+{
+    return ioStats;
+}
+
+
+void Reader::PrintIOStats(ostream &out) const
+{
+    for (auto const &s: ioStats)
+        out << s << '\n';
+}
+
+
 void Reader::SetSystematics(SystType systType, SystDirection systDirection)
 {
     // Update information about requested systematics
@@ -124,103 +384,232 @@ void Reader::SetSystematics(SystType systType, SystDirection systDirection)
     // If the type is Nominal (i.e. no variation), only direction Up is allowed
     if (curSystType == SystType::Nominal)
         curSystDirection = SystDirection::Up;
+}
+
+
+SystVariation Reader::GetSystematics() const noexcept
+{
+    return {curSystType, curSystDirection};
+}
+
+
+void Reader::ForEachSystematics(
+ function<void(SystVariation const &variation, unsigned index)> const &visitor)
+{
+    // Remember the current variation to restore it afterwards
+    SystType const origSystType = curSystType;
+    SystDirection const origSystDirection = curSystDirection;
+    
     
+    // Loop over the variations. In case of data only the nominal configuration is meaningful
+    auto const &variations = GetAllSystVariations();
+    unsigned const nVariations = (isMC) ? variations.size() : 1;
+    
+    for (unsigned i = 0; i < nVariations; ++i)
+    {
+        SetSystematics(variations[i].type, variations[i].direction);
+        visitor(variations[i], i);
+    }
     
-    // The stored weight might not be up-to-date anymore since it might be affected by the
-    //systematics
-    weightCached = false;
+    
+    SetSystematics(origSystType, origSystDirection);
+}
+
+
+void Reader::ForEachKinematicSystematics(function<void(SystVariation const &variation,
+ vector<unsigned> const &weightVariations)> const &visitor)
+{
+    // Group variations by kinematics. Indices of variations that share the nominal kinematics are
+    //stored in the first group, and each kinematic variation is given a group of its own
+    static vector<vector<unsigned>> const groups = []()
+    {
+        auto const &variations = GetAllSystVariations();
+        vector<vector<unsigned>> groups(1);
+        
+        for (unsigned i = 0; i < variations.size(); ++i)
+        {
+            if (IsKinematic(variations[i].type))
+                groups.emplace_back(1, i);
+            else
+                groups.front().push_back(i);
+        }
+        
+        return groups;
+    }();
+    
+    static vector<unsigned> const nominalOnly{0};
+    
+    
+    // Remember the current variation to restore it afterwards
+    SystType const origSystType = curSystType;
+    SystDirection const origSystDirection = curSystDirection;
+    
+    
+    // Loop over the groups. In case of data only the nominal configuration is meaningful
+    auto const &variations = GetAllSystVariations();
+    
+    if (not isMC)
+    {
+        SetSystematics(SystType::Nominal, SystDirection::Up);
+        visitor(variations.front(), nominalOnly);
+    }
+    else
+        for (auto const &g: groups)
+        {
+            // The variation that defines kinematics is always the first one in the group
+            SystVariation const &v = variations[g.front()];
+            SetSystematics(v.type, v.direction);
+            visitor(v, g);
+        }
+    
+    
+    SetSystematics(origSystType, origSystDirection);
 }
 
 
-vector<Lepton> const &Reader::GetLeptons() const noexcept
+LeptonCollection const &Reader::GetLeptons() const noexcept
 {
-    return leptons;
+    return curEvent->leptons;
 }
 
 
-vector<Jet> const &Reader::GetJets() const noexcept
+JetCollection const &Reader::GetJets()
 {
     if (isMC and curSystType == SystType::JEC)
     {
+        BuildJECCollections(*curEvent);
+        
         if (curSystDirection == SystDirection::Up)
-            return jetsJECUp;
+            return curEvent->jetsJECUp;
         else
-            return jetsJECDown;
+            return curEvent->jetsJECDown;
     }
     else
-        return jets;
+        return curEvent->jets;
 }
 
 
-MET const &Reader::GetMET() const noexcept
+MET const &Reader::GetMET()
 {
     if (isMC and curSystType == SystType::JEC)
     {
+        BuildJECCollections(*curEvent);
+        
         if (curSystDirection == SystDirection::Up)
-            return metJECUp;
+            return curEvent->metJECUp;
         else
-            return metJECDown;
+            return curEvent->metJECDown;
     }
     else
-        return met;
+        return curEvent->met;
 }
 
 
 double Reader::GetWeight() noexcept
+{
+    return GetWeight({curSystType, curSystDirection});
+}
+
+
+double Reader::GetWeight(SystVariation const &variation) noexcept
 {
     // If the current sample is data, the answer is trivial
     if (not isMC)
         return 1.;
     
     
-    // Check if the weight is up-to-date
-    if (weightCached)
-        return weight;
+    // Check if the weight is up-to-date and recalculate it otherwise
+    unsigned const index = GetSystIndex(variation);
     
+    if (cachedWeightStamps[index] != eventCounter)
+    {
+        cachedWeights[index] = CalculateWeight(variation.type, variation.direction);
+        cachedWeightStamps[index] = eventCounter;
+    }
     
-    // Recalculate the weight. Note that if the workflow reaches this point, the current sample is
-    //simulation
+    return cachedWeights[index];
+}
+
+
+void Reader::GetWeights(vector<double> &weights)
+{
+    unsigned const nVariations = GetAllSystVariations().size();
     
-    // Raw weights stored in the trees inlcude effects of pile-up, lepton scale factors, and
-    //normalisation for the cross section and integrated luminosity
-    weight = rawWeight;
     
+    // If the current sample is data, the answer is trivial
+    if (not isMC)
+    {
+        weights.assign(nVariations, 1.);
+        return;
+    }
     
-    // Reweighting for the b-tagging scale factors
-    if (applyBTagReweighting)
-        for (auto const &j: jets)
-        {
-            double const perJetBTagWeight =
-             csvReweighter.CalculateJetWeight(j, curSystType, curSystDirection);
-            
-            if (perJetBTagWeight != 0.)
-                weight *= perJetBTagWeight;
-        }
     
+    // Evaluate b-tagging weights for all variations and include the raw weight
+    GetBTagWeights(weights);
     
-    // The weight is now cached
-    weightCached = true;
+    for (auto &w: weights)
+        w *= curEvent->rawWeight;
     
     
-    // Return the weight
-    return weight;
+    // Update the cache
+    cachedWeights = weights;
+    cachedWeightStamps.assign(nVariations, eventCounter);
+}
+
+
+double Reader::GetRawWeight() const noexcept
+{
+    return (isMC) ? curEvent->rawWeight : 1.;
+}
+
+
+void Reader::GetBTagWeights(vector<double> &weights) const
+{
+    if (isMC and applyBTagReweighting)
+        csvReweighter->CalculateEventWeights(curEvent->jets, weights);
+    else
+        weights.assign(GetAllSystVariations().size(), 1.);
+}
+
+
+void Reader::GetJetBTagWeights(vector<double> &weights) const
+{
+    if (isMC and applyBTagReweighting)
+        csvReweighter->CalculateJetWeights(curEvent->jets, weights);
+    else
+        weights.assign(curEvent->jets.size() * GetAllSystVariations().size(), 1.);
 }
 
 
 unsigned Reader::GetNumPV() const noexcept
 {
-    return nPV;
+    return curEvent->nPV;
+}
+
+
+unsigned long Reader::GetEventCounter() const noexcept
+{
+    return eventCounter;
 }
 
 
 void Reader::SwitchBTagReweighting(bool on /*= true*/)
 {
     applyBTagReweighting = on;
+    
+    // Weights cached in the reader or by external caches (e.g. DerivedQuantities) might have been
+    //computed with a different setting. Change the counter so that they are no longer up-to-date
+    ++eventCounter;
 }
 
 
 void Reader::GetTree(string const &name)
 {
+    // Finalise input statistics and the skimmed copy of the previous tree
+    RecordIOStats();
+    WriteSkimTree();
+    
+    
     // Get the tree from the source file
     //curTree.reset(dynamic_cast<TTree *>(srcFile->Get(name.c_str())));
     curTree.reset(dynamic_cast<TTree *>(srcFile->Get(name.c_str())));
@@ -235,57 +624,549 @@ void Reader::GetTree(string const &name)
     }
     
     
-    // Set event counters
-    nEntries = curTree->GetEntries();
-    curEntry = 0;
+    // Set event counters and restrict reading to the requested range of entries
+    curTreeSize = curTree->GetEntries();
+    SetUpEntryRange();
     
     
     // Set buffers to read the tree
-    curTree->SetBranchAddress("nlepton", &lepSize);
-    curTree->SetBranchAddress("lept_pt", lepPt);
-    curTree->SetBranchAddress("lept_eta", lepEta);
-    curTree->SetBranchAddress("lept_phi", lepPhi);
-    curTree->SetBranchAddress("lept_iso", lepIso);
-    curTree->SetBranchAddress("lept_flav", lepFlavour);
+    SetUpBranches();
     
-    curTree->SetBranchAddress("njets", &jetSize);
-    curTree->SetBranchAddress("jet_pt", jetPt);
-    curTree->SetBranchAddress("jet_eta", jetEta);
-    curTree->SetBranchAddress("jet_phi", jetPhi);
-    curTree->SetBranchAddress("jet_btagdiscri", jetBTag);
-    curTree->SetBranchAddress("jet_flav", jetFlavour);
     
-    curTree->SetBranchAddress("met_pt", &metPt);
-    curTree->SetBranchAddress("met_phi", &metPhi);
+    // If a skim is being produced and the tree contains entries to be read, create an empty copy
+    //of the tree in the output file. Only the active branches are copied, and they share the read
+    //buffers with the source tree. The current ROOT directory is restored afterwards
+    if (skimFile and nEntries > curEntry)
+    {
+        TDirectory::TContext context(skimFile);
+        skimTree.reset(curTree->CloneTree(0));
+        skimTree->SetDirectory(skimFile);
+        
+        if (skimWeightComponents)
+            SetUpSkimWeightBranches();
+    }
+}
+
+
+void Reader::SetUpEntryRange() noexcept
+{
+    // Start input statistics for the current tree
+    readCallsAtStart = srcFile->GetReadCalls();
+    bytesReadAtStart = srcFile->GetBytesRead();
+    ioStatsPending = true;
     
-    curTree->SetBranchAddress("nvertex", &nPV);
+    
+    // Restrict reading to the requested range of entries
+    unsigned long const curTreeEnd = curTreeOffset + curTreeSize;
+    curEntry = min(max(entryRange.begin, curTreeOffset), curTreeEnd) - curTreeOffset;
+    nEntries = min(max(entryRange.end, curTreeOffset), curTreeEnd) - curTreeOffset;
+    
+    if (nEntries < curEntry)
+        nEntries = curEntry;
+}
+
+
+void Reader::WriteSkimTree()
+{
+    if (not skimTree)
+        return;
+    
+    TDirectory::TContext context(skimFile);
+    skimTree->Write();
+    skimTree.reset();
+}
+
+
+void Reader::SetUpSkimWeightBranches()
+{
+    // Allocate the buffers. The one for per-jet weights must accommodate the largest number of
+    //jets in the current tree
+    unsigned const nVariations = GetAllSystVariations().size();
+    skimBTagWeights.resize(nVariations);
+    skimJetBTagWeights.resize(max<unsigned>(directEvent.jets.GetCapacity(), 1) * nVariations);
+    
+    
+    // Create the branches or update their addresses
+    if (skimTree->GetBranch("btagweight"))
+    {
+        skimTree->SetBranchAddress("btagweight", skimBTagWeights.data());
+        skimTree->SetBranchAddress("jet_btagweight", skimJetBTagWeights.data());
+    }
+    else
+    {
+        ostringstream leafList;
+        leafList << "btagweight[" << nVariations << "]/D";
+        skimTree->Branch("btagweight", skimBTagWeights.data(), leafList.str().c_str());
+        
+        leafList.str("");
+        leafList << "jet_btagweight[njets][" << nVariations << "]/D";
+        skimTree->Branch("jet_btagweight", skimJetBTagWeights.data(), leafList.str().c_str());
+    }
+}
+
+
+void Reader::SetUpBranches()
+{
+    // Switch off all branches. Only the ones needed to build the active collections will be read
+    curTree->SetBranchStatus("*", false);
+    
+    sizeBranches.clear();
+    payloadBranches.clear();
+    jecBranches.clear();
+    
+    
+    // Reset the buffers so that collections that are not read are empty
+    lepSize = jetSize = jetJECUpSize = jetJECDownSize = 0;
+    metPt = metPhi = metJECUpPt = metJECUpPhi = metJECDownPt = metJECDownPhi = 0.;
+    nPV = 0;
+    rawWeight = 1.;
+    
+    
+    // Set buffers for the active collections. Properties of leptons and jets are read directly
+    //into storage of the collections of directEvent, so that they need not be copied. The storage
+    //is enlarged if the current tree contains larger collections than the previous ones
+    LeptonCollection &leptons = directEvent.leptons;
+    JetCollection &jets = directEvent.jets;
+    JetCollection &jetsJECUp = directEvent.jetsJECUp;
+    JetCollection &jetsJECDown = directEvent.jetsJECDown;
+    
+    if (IsActive(Collection::Leptons))
+    {
+        SetUpBranch("nlepton", &lepSize, sizeBranches);
+        leptons.SetCapacity(GetMaxLength("nlepton"));
+        SetUpBranch("lept_pt", leptons.PtBuffer(), payloadBranches);
+        SetUpBranch("lept_eta", leptons.EtaBuffer(), payloadBranches);
+        SetUpBranch("lept_phi", leptons.PhiBuffer(), payloadBranches);
+        SetUpBranch("lept_iso", leptons.IsolationBuffer(), payloadBranches);
+        SetUpBranch("lept_flav", leptons.FlavourBuffer(), payloadBranches);
+    }
+    
+    // Nominal jets are also needed to calculate the b-tagging weight
+    if (IsActive(Collection::Jets) or (isMC and IsActive(Collection::Weight)))
+    {
+        SetUpBranch("njets", &jetSize, sizeBranches);
+        jets.SetCapacity(GetMaxLength("njets"));
+        SetUpBranch("jet_pt", jets.PtBuffer(), payloadBranches);
+        SetUpBranch("jet_eta", jets.EtaBuffer(), payloadBranches);
+        SetUpBranch("jet_phi", jets.PhiBuffer(), payloadBranches);
+        SetUpBranch("jet_btagdiscri", jets.BTagBuffer(), payloadBranches);
+        SetUpBranch("jet_flav", jets.FlavourBuffer(), payloadBranches);
+    }
+    
+    if (IsActive(Collection::MET))
+    {
+        SetUpBranch("met_pt", &metPt, payloadBranches);
+        SetUpBranch("met_phi", &metPhi, payloadBranches);
+    }
+    
+    if (IsActive(Collection::NumPV))
+        SetUpBranch("nvertex", &nPV, payloadBranches);
     
     if (isMC)
     {
-        curTree->SetBranchAddress("jesup_njets", &jetJECUpSize);
-        curTree->SetBranchAddress("jet_jesup_pt", jetJECUpPt);
-        curTree->SetBranchAddress("jet_jesup_eta", jetJECUpEta);
-        curTree->SetBranchAddress("jet_jesup_phi", jetJECUpPhi);
-        curTree->SetBranchAddress("jet_jesup_btagdiscri", jetJECUpBTag);
-        curTree->SetBranchAddress("jet_jesup_flav", jetJECUpFlavour);
+        if (IsActive(Collection::JetsJEC))
+        {
+            SetUpBranch("jesup_njets", &jetJECUpSize, sizeBranches);
+            jetsJECUp.SetCapacity(GetMaxLength("jesup_njets"));
+            SetUpBranch("jet_jesup_pt", jetsJECUp.PtBuffer(), jecBranches);
+            SetUpBranch("jet_jesup_eta", jetsJECUp.EtaBuffer(), jecBranches);
+            SetUpBranch("jet_jesup_phi", jetsJECUp.PhiBuffer(), jecBranches);
+            SetUpBranch("jet_jesup_btagdiscri", jetsJECUp.BTagBuffer(), jecBranches);
+            SetUpBranch("jet_jesup_flav", jetsJECUp.FlavourBuffer(), jecBranches);
+            
+            SetUpBranch("jesdown_njets", &jetJECDownSize, sizeBranches);
+            jetsJECDown.SetCapacity(GetMaxLength("jesdown_njets"));
+            SetUpBranch("jet_jesdown_pt", jetsJECDown.PtBuffer(), jecBranches);
+            SetUpBranch("jet_jesdown_eta", jetsJECDown.EtaBuffer(), jecBranches);
+            SetUpBranch("jet_jesdown_phi", jetsJECDown.PhiBuffer(), jecBranches);
+            SetUpBranch("jet_jesdown_btagdiscri", jetsJECDown.BTagBuffer(), jecBranches);
+            SetUpBranch("jet_jesdown_flav", jetsJECDown.FlavourBuffer(), jecBranches);
+        }
+        
+        if (IsActive(Collection::METJEC))
+        {
+            SetUpBranch("met_jesup_pt", &metJECUpPt, jecBranches);
+            SetUpBranch("met_jesup_phi", &metJECUpPhi, jecBranches);
+            
+            SetUpBranch("met_jesdown_pt", &metJECDownPt, jecBranches);
+            SetUpBranch("met_jesdown_phi", &metJECDownPhi, jecBranches);
+        }
+        
+        if (IsActive(Collection::Weight))
+            SetUpBranch("evtweight", &rawWeight, payloadBranches);
+    }
+    
+    
+    // Storage of the collections might have been reallocated. Update addresses in the skimmed
+    //copy of the tree if it exists
+    if (skimTree)
+    {
+        curTree->CopyAddresses(skimTree.get());
+        
+        if (skimWeightComponents)
+            SetUpSkimWeightBranches();
+    }
+    
+    
+    // Branches to be read are known. Set up the cache for them
+    SetUpCache();
+}
+
+
+void Reader::SetUpBranch(string const &name, void *address, vector<TBranch *> &branches)
+{
+    // Make sure the branch exists
+    if (not curTree->GetBranch(name.c_str()))
+    {
+        ostringstream ost;
+        ost << "Cannot find branch \"" << name << "\" in tree \"" << curTree->GetName() << "\".";
+        throw runtime_error(ost.str());
+    }
+    
+    
+    curTree->SetBranchStatus(name.c_str(), true);
+    curTree->SetBranchAddress(name.c_str(), address);
+    branches.push_back(curTree->GetBranch(name.c_str()));
+}
+
+
+unsigned Reader::GetMaxLength(string const &counterName) const
+{
+    TLeaf const *leaf = curTree->GetLeaf(counterName.c_str());
+    
+    if (not leaf)
+    {
+        ostringstream ost;
+        ost << "Cannot find leaf \"" << counterName << "\" in tree \"" << curTree->GetName() <<
+         "\".";
+        throw runtime_error(ost.str());
+    }
+    
+    return max(leaf->GetMaximum(), 1);
+}
+
+
+double Reader::CalculateWeight(SystType systType, SystDirection systDirection) const noexcept
+{
+    // Raw weights stored in the trees inlcude effects of pile-up, lepton scale factors, and
+    //normalisation for the cross section and integrated luminosity
+    double w = curEvent->rawWeight;
+    
+    
+    // Reweighting for the b-tagging scale factors
+    if (applyBTagReweighting)
+        for (auto const j: curEvent->jets)
+        {
+            double const perJetBTagWeight = csvReweighter->CalculateJetWeight(j.Pt(), j.Eta(),
+             j.BTag(), j.Flavour(), systType, systDirection);
+            
+            if (perJetBTagWeight != 0.)
+                w *= perJetBTagWeight;
+        }
+    
+    
+    return w;
+}
+
+
+bool Reader::ReadEntry()
+{
+    while (true)
+    {
+        // Check if there are events left in the current source tree
+        while (curEntry == nEntries)  // no more events in the current tree
+        {
+            // Check if there are more source trees and the requested range extends into them
+            if (next(curTreeNameIt) == treeNames.end() or
+             curTreeOffset + curTreeSize >= entryRange.end)
+            {
+                RecordIOStats();
+                return false;
+            }
+            
+            curTreeOffset += curTreeSize;
+            ++curTreeNameIt;
+            GetTree(*curTreeNameIt);
+        }
+        
+        
+        // Either there were events in the current source file or a new file has been opened. Read
+        //multiplicities of objects and check the preselection
+        for (auto &b: sizeBranches)
+            b->GetEntry(curEntry);
         
-        curTree->SetBranchAddress("jesdown_njets", &jetJECDownSize);
-        curTree->SetBranchAddress("jet_jesdown_pt", jetJECDownPt);
-        curTree->SetBranchAddress("jet_jesdown_eta", jetJECDownEta);
-        curTree->SetBranchAddress("jet_jesdown_phi", jetJECDownPhi);
-        curTree->SetBranchAddress("jet_jesdown_btagdiscri", jetJECDownBTag);
-        curTree->SetBranchAddress("jet_jesdown_flav", jetJECDownFlavour);
+        CheckSizes();
+        
+        if (preselection and not preselection({unsigned(lepSize), unsigned(jetSize),
+         unsigned(jetJECUpSize), unsigned(jetJECDownSize)}))
+        {
+            ++curEntry;
+            continue;
+        }
         
-        curTree->SetBranchAddress("met_jesup_pt", &metJECUpPt);
-        curTree->SetBranchAddress("met_jesup_phi", &metJECUpPhi);
         
-        curTree->SetBranchAddress("met_jesdown_pt", &metJECDownPt);
-        curTree->SetBranchAddress("met_jesdown_phi", &metJECDownPhi);
+        // The event is accepted. Read properties of the objects
+        for (auto &b: payloadBranches)
+            b->GetEntry(curEntry);
         
-        curTree->SetBranchAddress("evtweight", &rawWeight);
+        ++curEntry;
+        return true;
     }
+}
+
+
+void Reader::UnpackEvent()
+{
+    // Properties of leptons and jets have been read into the collections. Set their sizes
+    directEvent.leptons.SetSize(lepSize);
+    directEvent.jets.SetSize(jetSize);
+    
+    directEvent.met.Set(metPt, metPhi);
+    directEvent.nPV = nPV;
+    directEvent.rawWeight = rawWeight;
+    
     
+    // Make sure collections of leptons and jets are ordered in pt. In most events they are
+    //ordered already, and nothing is done
+    directEvent.leptons.SortInPt();
+    directEvent.jets.SortInPt();
     
-    // Set the event weight for data (it will not be modified)
-    weight = 1.;
+    
+    // Collections affected by JEC variations will be built only if requested
+    directEvent.jecCollectionsBuilt = false;
+}
+
+
+void Reader::BuildJECCollections(Event &event)
+{
+    if (event.jecCollectionsBuilt)
+        return;
+    
+    
+    // Read the branches affected by JEC variations for the current event. Note that the entry
+    //counter has already been incremented
+    for (auto &b: jecBranches)
+        b->GetEntry(curEntry - 1);
+    
+    
+    // Properties of jets have been read into the collections. Set their sizes and copy MET from
+    //read buffers
+    event.jetsJECUp.SetSize(jetJECUpSize);
+    event.jetsJECDown.SetSize(jetJECDownSize);
+    
+    event.metJECUp.Set(metJECUpPt, metJECUpPhi);
+    event.metJECDown.Set(metJECDownPt, metJECDownPhi);
+    
+    
+    // Make sure the jets are ordered in pt
+    event.jetsJECUp.SortInPt();
+    event.jetsJECDown.SortInPt();
+    
+    
+    event.jecCollectionsBuilt = true;
+}
+
+
+void Reader::ReadAhead()
+{
+    try
+    {
+        while (true)
+        {
+            // Wait for a free buffer
+            unique_lock<mutex> lock(readAheadMutex);
+            readAheadCondition.wait(lock, [this](){return (stopReadAhead or
+             nProduced - nReleased < nReadAheadBuffers);});
+            
+            if (stopReadAhead)
+                return;
+            
+            Event &event = readAheadEvents[nProduced % nReadAheadBuffers];
+            lock.unlock();
+            
+            
+            // Read the next event and copy it into the buffer. Collections affected by JEC
+            //variations are built right away since the consumer must not read from the source file
+            bool const success = ReadEntry();
+            
+            if (success)
+            {
+                UnpackEvent();
+                BuildJECCollections(directEvent);
+                event = directEvent;
+            }
+            
+            
+            // Publish the event or indicate that there are no more events
+            lock.lock();
+            
+            if (success)
+                ++nProduced;
+            else
+                producerFinished = true;
+            
+            readAheadCondition.notify_all();
+            
+            if (not success)
+                return;
+        }
+    }
+    catch (...)
+    {
+        lock_guard<mutex> lock(readAheadMutex);
+        readAheadError = current_exception();
+        producerFinished = true;
+        readAheadCondition.notify_all();
+    }
+}
+
+
+bool Reader::TakeReadAheadEvent()
+{
+    // Start the background thread if it is not running yet
+    if (not readAheadThread.joinable())
+    {
+        if (producerFinished)
+            return false;
+        
+        nProduced = nTaken = nReleased = 0;
+        stopReadAhead = false;
+        readAheadThread = thread(&Reader::ReadAhead, this);
+    }
+    
+    
+    // Release the buffer with the previous event and wait for the next one
+    unique_lock<mutex> lock(readAheadMutex);
+    nReleased = nTaken;
+    readAheadCondition.notify_all();
+    readAheadCondition.wait(lock, [this](){return (nTaken < nProduced or producerFinished);});
+    
+    if (nTaken == nProduced)
+    {
+        // There are no more events or the background thread has failed
+        lock.unlock();
+        readAheadThread.join();
+        curEvent = &directEvent;
+        directEvent.Clear();
+        
+        if (readAheadError)
+        {
+            exception_ptr const error(readAheadError);
+            readAheadError = nullptr;
+            rethrow_exception(error);
+        }
+        
+        return false;
+    }
+    
+    curEvent = &readAheadEvents[nTaken % nReadAheadBuffers];
+    ++nTaken;
+    lock.unlock();
+    
+    
+    // Change the counter so that the cached weights are no longer up-to-date
+    ++eventCounter;
+    
+    return true;
+}
+
+
+void Reader::StopReadAhead() noexcept
+{
+    if (readAheadThread.joinable())
+    {
+        {
+            lock_guard<mutex> lock(readAheadMutex);
+            stopReadAhead = true;
+            readAheadCondition.notify_all();
+        }
+        
+        readAheadThread.join();
+    }
+    
+    
+    // The current event might reside in a read-ahead buffer. Drop it
+    curEvent = &directEvent;
+    directEvent.Clear();
+    ++eventCounter;
+    producerFinished = false;
+    readAheadError = nullptr;
+}
+
+
+void Reader::CheckNoReadAhead() const
+{
+    if (readAheadThread.joinable())
+        throw logic_error("Reader cannot be reconfigured while events are being read ahead.");
+}
+
+
+void Reader::SetUpCache()
+{
+    if (cacheSize <= 0)
+    {
+        curTree->SetCacheSize(0);
+        return;
+    }
+    
+    
+    // Cache exactly the branches that will be read. Since they are known, there is no need for the
+    //learning phase
+    curTree->SetCacheSize(cacheSize);
+    
+    // The asynchronous mode is set for the cache of this tree only. The global default in gEnv is
+    //not modified as it is shared with readers running in other threads
+    TTreeCache *cache = dynamic_cast<TTreeCache *>(srcFile->GetCacheRead(curTree.get()));
+    
+    if (cache)
+        cache->SetEnablePrefetching(asyncPrefetch);
+    
+    for (auto const &b: sizeBranches)
+        curTree->AddBranchToCache(b);
+    
+    for (auto const &b: payloadBranches)
+        curTree->AddBranchToCache(b);
+    
+    for (auto const &b: jecBranches)
+        curTree->AddBranchToCache(b);
+    
+    curTree->StopCacheLearningPhase();
+    
+    
+    // Do not cache entries outside of the range to be read
+    curTree->SetCacheEntryRange(curEntry, nEntries);
+}
+
+
+void Reader::RecordIOStats()
+{
+    // Nothing to record if there is no current tree or its statistics have been recorded already
+    if (not curTree or not ioStatsPending)
+        return;
+    
+    ioStats.push_back({curTree->GetName(), srcFile->GetReadCalls() - readCallsAtStart,
+     srcFile->GetBytesRead() - bytesReadAtStart});
+    ioStatsPending = false;
+}
+
+
+void Reader::CheckSizes() const
+{
+    Event const &e = directEvent;
+    
+    if (unsigned(lepSize) > e.leptons.GetCapacity() or unsigned(jetSize) > e.jets.GetCapacity() or
+     unsigned(jetJECUpSize) > e.jetsJECUp.GetCapacity() or
+     unsigned(jetJECDownSize) > e.jetsJECDown.GetCapacity())
+    {
+        ostringstream ost;
+        ost << "Multiplicity of objects in entry " << curEntry << " of tree \"" <<
+         curTree->GetName() << "\" exceeds the maximum declared in the tree.";
+        throw runtime_error(ost.str());
+    }
+}
+
+
+bool Reader::IsActive(Collection collection) const noexcept
+{
+    return ((activeCollections & (1u << unsigned(collection))) != 0);
 }
@@ -1,16 +1,86 @@
 #pragma once
 
 #include <PhysicsObjects.hpp>
+#include <Collections.hpp>
 #include <Systematics.hpp>
 #include <CSVReweighter.hpp>
+#include <Sharding.hpp>
+#include <EventBatch.hpp>
 
 #include <TFile.h>
 #include <TTree.h>
+#include <TBranch.h>
 
 #include <string>
 #include <vector>
+#include <ostream>
 #include <list>
 #include <memory>
+#include <initializer_list>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+
+/**
+ * \brief Collections of event properties that can be read from the source trees
+ * 
+ * Used to declare which properties an analysis needs, so that branches for all other properties
+ * are not read from the source file.
+ */
+enum class Collection
+{
+    Leptons,
+    Jets,
+    JetsJEC,
+    MET,
+    METJEC,
+    NumPV,
+    Weight
+};
+
+
+/**
+ * \struct Multiplicities
+ * \brief Numbers of reconstructed objects in an event
+ * 
+ * The numbers are read from the source trees before any other properties of the event and can be
+ * used for a fast preselection. Counts for collections that have not been requested are zero.
+ */
+struct Multiplicities
+{
+    /// Number of leptons
+    unsigned nLeptons;
+    
+    /// Number of nominal jets
+    unsigned nJets;
+    
+    /// Numbers of jets with JEC varied up and down
+    unsigned nJetsJECUp, nJetsJECDown;
+};
+
+
+/**
+ * \struct IOStats
+ * \brief Input statistics for a single source tree
+ */
+struct IOStats
+{
+    /// Name of the tree
+    std::string treeName;
+    
+    /// Number of read calls issued to the source file while the tree was read
+    Long64_t readCalls;
+    
+    /// Number of bytes read from the source file while the tree was read
+    Long64_t bytesRead;
+};
+
+
+/// Prints input statistics for a tree in a human-readable form
+std::ostream &operator<<(std::ostream &out, IOStats const &stats);
 
 
 /**
@@ -31,16 +101,21 @@ public:
      * The trees will be read one by one, in the specified order. An exception is thrown if the
      * source file does not exist or is corrupted. The flag isMC indicates if the sampe is a
      * simulation.
+     * 
+     * The object to perform CSV reweighting is shared among readers since it is immutable. If it
+     * is not given, the instance returned by CSVReweighter::GetDefault is used. It is only needed
+     * for simulation and is ignored for data.
      */
     Reader(std::shared_ptr<TFile> &srcFile, std::list<std::string> const &treeNames,
-     bool isMC = true);
+     bool isMC = true, std::shared_ptr<CSVReweighter const> csvReweighter = nullptr);
     
     /**
      * \brief Constructor from a source file and name of a single tree
      * 
      * Internally calls the first constructor.
      */
-    Reader(std::shared_ptr<TFile> &srcFile, std::string const &treeName, bool isMC = true);
+    Reader(std::shared_ptr<TFile> &srcFile, std::string const &treeName, bool isMC = true,
+     std::shared_ptr<CSVReweighter const> csvReweighter = nullptr);
     
     /// There is no construction without parameters
     Reader() = delete;
@@ -51,17 +126,92 @@ public:
     /// Assignment operator is disabled
     Reader &operator=(Reader const &) = delete;
     
+    /// Destructor. Stops the read-ahead thread if it is running
+    ~Reader() noexcept;
+    
 public:
     /**
      * \brief Reads next event from the source trees
      * 
      * Reads the next event from the source trees. Returns true in case of success and false if
-     * there are no more events to be read.
+     * there are no more events to be read. If a preselection has been set, events that fail it are
+     * skipped, and only the multiplicity branches are read for them.
+     * 
+     * In the read-ahead mode (see SetReadAhead), the event is taken from a buffer filled by a
+     * background thread, which is started on the first call.
      */
     bool ReadNextEvent();
     
-    /// Rewinds the reader to the first event in the first tree
-    void Rewind() noexcept;
+    /**
+     * \brief Writes events that pass the given predicate into a new file
+     * 
+     * The reader is rewound, and all events (within the entry range, if set, and passing the
+     * preselection) are read. Those for which the predicate returns true are written into trees
+     * with the same names as the source ones, which are placed in the given file. Source trees
+     * with no entries in the range are not copied. Only branches of the active collections are
+     * written. The resulting file can be read with this class in
+     * the same way as the original one, provided that only collections included in the skim are
+     * requested. Returns the number of events written. The reader is left at the end of the
+     * trees. Throws an exception in the read-ahead mode.
+     * 
+     * If the flag writeWeightComponents is set, the skimmed trees of simulation are complemented
+     * with branches "btagweight", which holds the result of GetBTagWeights, and "jet_btagweight",
+     * which holds the result of GetJetBTagWeights as a two-dimensional array indexed with the jet
+     * and the variation. Together with the branch "evtweight", they allow to recompute weights
+     * for all variations without rereading the source trees. The branches are only written if
+     * the collection Weight is active.
+     */
+    unsigned long Skim(TFile &outFile, std::function<bool(Reader &)> const &predicate,
+     bool writeWeightComponents = false);
+    
+    /**
+     * \brief Reads up to the given number of next events in columnar form
+     * 
+     * Events are read in the same way as with ReadNextEvent, including the preselection, but no
+     * objects are constructed. Instead, properties of the objects are copied into contiguous
+     * arrays of the returned batch. Jets and MET follow the systematical variation currently in
+     * effect. The batch is owned by the reader and is overwritten by the next call. It contains
+     * fewer events than requested only if there are no more events to read. Getters for individual
+     * events are not updated and are invalid after the call: they return an empty event until
+     * ReadNextEvent is called. Throws an exception in the read-ahead mode.
+     */
+    EventBatch const &ReadNextBatch(unsigned maxEvents);
+    
+    /**
+     * \brief Rewinds the reader to the first event in the first tree
+     * 
+     * If an entry range has been set, the reader is rewound to the first event in the range.
+     * Throws an exception if a tree or a branch needed to read it does not exist.
+     */
+    void Rewind();
+    
+    /**
+     * \brief Enables reading ahead in a background thread
+     * 
+     * If the given number of buffers is positive, events are read, preselected, and unpacked into
+     * leptons, jets, and MET by a background thread, while the calling thread processes events
+     * read earlier. Up to the given number of events are kept in memory at a time, including the
+     * current one. Collections affected by JEC variations are built for each event right away, so
+     * that the calling thread never reads from the source file. Zero buffers (the default) disable
+     * the mode. ROOT must have been initialised for multithreading (e.g. with
+     * TThread::Initialize), and the source file must not be used by other threads.
+     * 
+     * Once the background thread has been started, the reader cannot be reconfigured (with
+     * SetCollections, SetPreselection, or SetCacheSize) until it is rewound or reading is finished.
+     * Input statistics are complete only after reading is finished.
+     */
+    void SetReadAhead(unsigned nBuffers);
+    
+    /**
+     * \brief Restricts reading to the given range of entries
+     * 
+     * The range is expressed in global indices of entries, i.e. the trees are considered as if
+     * they were concatenated in the order given to the constructor. Ranges produced by the function
+     * SplitIntoShards can be used directly. The reader is rewound to the beginning of the range.
+     * Trees that precede it are not read, except that each tree is opened once, when the first
+     * range is set, to count its entries. By default all entries are read.
+     */
+    void SetEntryRange(EntryRange const &range);
     
     /**
      * \brief Sets desired systematical variation
@@ -72,27 +222,108 @@ public:
      */
     void SetSystematics(SystType systType, SystDirection systDirection);
     
+    /// Returns the systematical variation that is currently in effect
+    SystVariation GetSystematics() const noexcept;
+    
+    /**
+     * \brief Visits all systematical variations for the current event
+     * 
+     * For each variation from the list returned by GetAllSystVariations, the variation is put in
+     * effect and the visitor is called with the variation and its index in that list. Thus, inside
+     * the visitor all getters return results for the visited variation, while the event is read
+     * from the source trees only once. For data only the nominal configuration is visited. The
+     * variation that was in effect before the call is restored afterwards.
+     */
+    void ForEachSystematics(
+     std::function<void(SystVariation const &variation, unsigned index)> const &visitor);
+    
+    /**
+     * \brief Visits the nominal configuration and variations that alter kinematics
+     * 
+     * Similar to ForEachSystematics, but only the nominal configuration and variations for which
+     * IsKinematic returns true are put in effect. Along with the visited variation, the visitor
+     * receives indices (in the list returned by GetAllSystVariations) of all variations that share
+     * its kinematics. For the nominal configuration these are itself and all variations that
+     * affect the weight only, and for a kinematic variation it is only the variation itself. Thus,
+     * the selection needs to be evaluated once per visit, and the weights for the variations can
+     * be obtained with the method GetWeight(SystVariation const &).
+     */
+    void ForEachKinematicSystematics(std::function<void(SystVariation const &variation,
+     std::vector<unsigned> const &weightVariations)> const &visitor);
+    
+    /**
+     * \brief Restricts reading to the given collections
+     * 
+     * Branches that are not needed to build the given collections are switched off and are never
+     * read from the source trees. Getters for collections that have not been requested return
+     * empty collections or default values. Collections JetsJEC, METJEC, and Weight are only
+     * meaningful for simulation; the weight additionally requires nominal jets, which are read
+     * automatically. By default all collections are read. The method can be called at any time and
+     * affects all subsequent events.
+     */
+    void SetCollections(std::initializer_list<Collection> const &collections);
+    
+    /**
+     * \brief Sets a preselection based on multiplicities of reconstructed objects
+     * 
+     * Events are read in two stages. At first only branches with multiplicities are read, and the
+     * given predicate is evaluated. Properties of objects are read only if the predicate returns
+     * true; otherwise the event is skipped. An empty function disables the preselection.
+     */
+    void SetPreselection(std::function<bool(Multiplicities const &)> const &preselection);
+    
+    /**
+     * \brief Sets size of the TTreeCache, in bytes
+     * 
+     * Exactly the branches needed for the active collections are added to the cache, and the
+     * learning phase is skipped. A zero size disables the cache. By default the size is 10 MiB.
+     */
+    void SetCacheSize(Long64_t cacheSize);
+    
+    /**
+     * \brief Switches asynchronous prefetching of the TTreeCache on or off
+     * 
+     * If switched on, the cache is filled by a separate thread while the current block of
+     * events is being processed. The setting applies to this reader only and takes effect
+     * starting from the next tree. It is off by default.
+     */
+    void SwitchAsyncPrefetch(bool on = true);
+    
+    /**
+     * \brief Returns input statistics for trees read so far
+     * 
+     * Statistics for a tree are recorded when reading of the tree is finished.
+     */
+    std::vector<IOStats> const &GetIOStats() const noexcept;
+    
+    /// Prints input statistics for trees read so far
+    void PrintIOStats(std::ostream &out) const;
+    
     /**
      * \brief Returns the collection of leptons in the current event
      * 
      * The collection is ordered in pt, in the decreasing order.
      */
-    std::vector<Lepton> const &GetLeptons() const noexcept;
+    LeptonCollection const &GetLeptons() const noexcept;
     
     /**
      * \brief Returns the collection of jets in the current event
      * 
      * The collection is ordered in pt, in the decreasing order. If the JEC systematical variations
      * have been requested, the appropriate jet collection is returned insted of the nominal one.
+     * Collections with JEC variations are read from the source tree and built when they are
+     * requested for the first time in the current event, hence the method is not constant.
      */
-    std::vector<Jet> const &GetJets() const noexcept;
+    JetCollection const &GetJets();
     
     /**
      * \brief Returns MET of the current event
      * 
-     * If the JEC systematical variations have been requested, the MET is altered accordingly.
+     * If the JEC systematical variations have been requested, the MET is altered accordingly. As
+     * with jets, the varied MET is read only when it is requested for the first time in the current
+     * event.
      */
-    MET const &GetMET() const noexcept;
+    MET const &GetMET();
     
     /**
      * \brief Returns weight of the current event
@@ -101,15 +332,73 @@ public:
      * reweighting for cross section and target integrated luminosity, lepton ID scale factors,
      * pile-up, and b-tagging. The weight can be affected by systematics.
      * 
-     * When the method is called for the first time for an event, the weight is calculated and
-     * cached. Thus, the weight is not recalculated in subsequent calls for the same event, unless
-     * the user calls the SetSystematics method, which destroys the cache.
+     * When the method is called for the first time for an event and the variation in effect, the
+     * weight is calculated and cached. The cache holds a separate value for each variation, and
+     * thus the weight is not recalculated in subsequent calls for the same event even if the
+     * variation in effect is changed with the method SetSystematics in between.
      */
     double GetWeight() noexcept;
     
+    /**
+     * \brief Returns weight of the current event for the given systematical variation
+     * 
+     * The variation in effect is not changed. Since b-tagging weights are always evaluated with
+     * nominal jets, the weight for any variation can be obtained regardless of the variation in
+     * effect. The weight is cached in the same way as in GetWeight().
+     */
+    double GetWeight(SystVariation const &variation) noexcept;
+    
+    /**
+     * \brief Computes weights of the current event for all systematical variations at once
+     * 
+     * The weights are written into the given vector in the order of GetAllSystVariations. The
+     * vector is resized as needed. Since bins for b-tagging weights are found only once for all
+     * variations, this is much faster than calling GetWeight(SystVariation const &) for each of
+     * them. The variation in effect is not changed. The computed weights are also stored in the
+     * cache used by the method GetWeight.
+     */
+    void GetWeights(std::vector<double> &weights);
+    
+    /**
+     * \brief Returns the weight stored in the source tree for the current event
+     * 
+     * The weight includes all corrections except for the b-tagging reweighting. Always equals 1.
+     * for data.
+     */
+    double GetRawWeight() const noexcept;
+    
+    /**
+     * \brief Computes products of per-jet b-tagging weights in the current event
+     * 
+     * The products are written into the given vector in the order of GetAllSystVariations. The
+     * weight for a variation, as returned by GetWeight, is the product of the raw weight and the
+     * corresponding element. For data or if the b-tagging reweighting is switched off, all
+     * elements are 1.
+     */
+    void GetBTagWeights(std::vector<double> &weights) const;
+    
+    /**
+     * \brief Computes per-jet b-tagging weights in the current event
+     * 
+     * The weight of jet i for variation j (indexed as in GetAllSystVariations) is written to
+     * weights[i * nVariations + j], where nVariations is the number of variations. Jets whose
+     * weight is zero are skipped in the products returned by GetBTagWeights. For data or if the
+     * b-tagging reweighting is switched off, all elements are 1.
+     */
+    void GetJetBTagWeights(std::vector<double> &weights) const;
+    
     /// Returns the number of reconstructed primary vertices in the current event
     unsigned GetNumPV() const noexcept;
     
+    /**
+     * \brief Returns a counter that identifies the current event
+     * 
+     * The counter changes whenever a new event is read or the current one is dropped, and also
+     * when the b-tagging reweighting is switched on or off. It allows external caches of per-event
+     * quantities to detect that they are outdated.
+     */
+    unsigned long GetEventCounter() const noexcept;
+    
     /**
      * \brief Switches reweighting for b-tagging on or off
      * 
@@ -119,6 +408,49 @@ public:
      */
     void SwitchBTagReweighting(bool on = true);
     
+private:
+    /**
+     * \struct Event
+     * \brief Properties of a single event, unpacked from read buffers
+     */
+    struct Event
+    {
+        /// Leptons
+        LeptonCollection leptons;
+        
+        /// Nominal jets
+        JetCollection jets;
+        
+        /**
+         * \brief Jets with JEC varied up and down
+         * 
+         * Built on demand, see the method BuildJECCollections.
+         */
+        JetCollection jetsJECUp, jetsJECDown;
+        
+        /// Nominal MET
+        MET met;
+        
+        /**
+         * \brief MET with JEC varied up and down
+         * 
+         * Built on demand, see the method BuildJECCollections.
+         */
+        MET metJECUp, metJECDown;
+        
+        /// Indicates if collections affected by JEC variations have been built
+        bool jecCollectionsBuilt = true;
+        
+        /// Number of reconstructed primary vertices
+        unsigned nPV = 0;
+        
+        /// Weight stored in the source tree
+        double rawWeight = 1.;
+        
+        /// Resets the event to an empty one, keeping the storage of the collections
+        void Clear() noexcept;
+    };
+    
 private:
     /**
      * \brief Gets a new tree from the source file and sets up buffers to read it
@@ -128,6 +460,106 @@ private:
      */
     void GetTree(std::string const &name);
     
+    /**
+     * \brief Starts input statistics for the current tree and restricts reading to the requested
+     * range of entries in it
+     * 
+     * The offset and the size of the current tree must have been set.
+     */
+    void SetUpEntryRange() noexcept;
+    
+    /**
+     * \brief Sets up buffers for branches of the current tree
+     * 
+     * Only branches needed for the active collections are switched on.
+     */
+    void SetUpBranches();
+    
+    /**
+     * \brief Switches on a branch in the current tree and sets its buffer
+     * 
+     * The branch is added to the given list. Throws an exception if the branch does not exist.
+     */
+    void SetUpBranch(std::string const &name, void *address, std::vector<TBranch *> &branches);
+    
+    /**
+     * \brief Returns the maximal value of the given counter branch in the current tree
+     * 
+     * The value is taken from the metadata of the leaf, and it is used to size the collections
+     * into which arrays indexed by the counter are read. Never returns zero.
+     */
+    unsigned GetMaxLength(std::string const &counterName) const;
+    
+    /**
+     * \brief Reads and builds collections affected by JEC variations for the given event
+     * 
+     * Does nothing if the collections have already been built for the event. Otherwise the event
+     * must be directEvent, and the entry that has been read last is used.
+     */
+    void BuildJECCollections(Event &event);
+    
+    /**
+     * \brief Reads branches for the next event that passes the preselection
+     * 
+     * Switches to the next tree if needed. Returns false if there are no more events.
+     */
+    bool ReadEntry();
+    
+    /**
+     * \brief Builds directEvent from the entry that has just been read
+     * 
+     * Properties of leptons and jets have already been read into the collections, and only their
+     * sizes are set and the objects are ordered in pt. Collections affected by JEC variations are
+     * not built.
+     */
+    void UnpackEvent();
+    
+    /// Body of the read-ahead thread
+    void ReadAhead();
+    
+    /**
+     * \brief Takes the next event from the read-ahead buffers
+     * 
+     * The buffer holding the previous event is released. Starts the read-ahead thread if needed.
+     * Returns false if there are no more events.
+     */
+    bool TakeReadAheadEvent();
+    
+    /// Stops the read-ahead thread and drops all buffered events
+    void StopReadAhead() noexcept;
+    
+    /// Writes the skimmed copy of the current tree, if any, and deletes it
+    void WriteSkimTree();
+    
+    /**
+     * \brief Creates branches with components of the event weight in the skimmed tree
+     * 
+     * If the branches exist already, updates their addresses.
+     */
+    void SetUpSkimWeightBranches();
+    
+    /// Throws an exception if the read-ahead thread is running
+    void CheckNoReadAhead() const;
+    
+    /// Calculates weight of the current event of simulation for the given variation
+    double CalculateWeight(SystType systType, SystDirection systDirection) const noexcept;
+    
+    /// Sets up the TTreeCache for the branches that are read
+    void SetUpCache();
+    
+    /// Records input statistics for the current tree
+    void RecordIOStats();
+    
+    /**
+     * \brief Checks that multiplicities of objects in the entry being read fit into the storage
+     * 
+     * Guards against trees with inconsistent metadata. Throws an exception if the check fails.
+     */
+    void CheckSizes() const;
+    
+    /// Checks if the given collection has been requested
+    bool IsActive(Collection collection) const noexcept;
+    
 private:
     /// Pointer to the source file
     std::shared_ptr<TFile> srcFile;
@@ -135,8 +567,8 @@ private:
     /// Names of trees to be read from the source file
     std::list<std::string> treeNames;
     
-    /// An object to perform CSV reweighting
-    CSVReweighter csvReweighter;
+    /// An object to perform CSV reweighting, shared with other readers; null for data
+    std::shared_ptr<CSVReweighter const> csvReweighter;
     
     /// Iterator that points to the name of the current tree
     decltype(treeNames)::iterator curTreeNameIt;
@@ -144,7 +576,59 @@ private:
     /// Pointer to the current tree
     std::unique_ptr<TTree> curTree;
     
-    /// Number of events in the current tree
+    /// Branches with multiplicities of objects, which are read at the first stage
+    std::vector<TBranch *> sizeBranches;
+    
+    /// Branches with properties of objects, which are read for preselected events only
+    std::vector<TBranch *> payloadBranches;
+    
+    /**
+     * \brief Branches with properties of objects affected by JEC variations
+     * 
+     * They are read only when these variations are requested for the current event.
+     */
+    std::vector<TBranch *> jecBranches;
+    
+    /// Optional preselection based on multiplicities of objects
+    std::function<bool(Multiplicities const &)> preselection;
+    
+    /// Size of the TTreeCache, in bytes
+    Long64_t cacheSize;
+    
+    /// Indicates if the TTreeCache should be filled asynchronously
+    bool asyncPrefetch;
+    
+    /// Input statistics for trees read so far
+    std::vector<IOStats> ioStats;
+    
+    /// Values of counters of the source file when reading of the current tree started
+    Long64_t readCallsAtStart, bytesReadAtStart;
+    
+    /// Indicates that input statistics for the current tree have not been recorded yet
+    bool ioStatsPending;
+    
+    /// Range of entries to be read, in global indices
+    EntryRange entryRange;
+    
+    /// Global index of the first entry in the current tree
+    unsigned long curTreeOffset;
+    
+    /// Total number of entries in the current tree
+    unsigned long curTreeSize;
+    
+    /**
+     * \brief Numbers of entries in all trees
+     * 
+     * Filled when an entry range that does not start at the first entry is set for the first
+     * time. Used to skip the trees preceding the range without reading them.
+     */
+    std::vector<unsigned long> treeSizes;
+    
+    /**
+     * \brief Index of the entry in the current tree at which reading stops
+     * 
+     * Equals the number of events in the tree unless an entry range has been set.
+     */
     unsigned long nEntries;
     
     /// Index of the current event in the current tree
@@ -153,6 +637,13 @@ private:
     /// Flag that indicates if the current sample is simulation
     bool isMC;
     
+    /**
+     * \brief Collections to be read from the source trees
+     * 
+     * Encoded as a bit mask, with one bit per value of the enumeration Collection.
+     */
+    unsigned activeCollections;
+    
     /**
      * \brief Type of systematical variation that is in effect currently
      * 
@@ -167,31 +658,73 @@ private:
      */
     SystDirection curSystDirection;
     
-    /// Size of buffers to read the source tree
-    static unsigned const maxSize = 64;
+    /**
+     * \brief Event read and unpacked in the calling thread
+     * 
+     * Storage of its collections is used as buffers to read the source tree. Its capacity is
+     * adjusted to the maximal multiplicities in each tree and is never reduced. In the read-ahead
+     * mode the event is filled by the background thread and copied into the ring of buffers.
+     */
+    Event directEvent;
+    
+    /// Number of read-ahead buffers; zero means that the mode is disabled
+    unsigned nReadAheadBuffers;
     
-    /// Leptons in the current events
-    std::vector<Lepton> leptons;
+    /// Ring of buffers for events read ahead
+    std::vector<Event> readAheadEvents;
     
     /**
-     * \brief Jets in the current event
+     * \brief Counters of events in the ring of read-ahead buffers
      * 
-     * Nominal collection and variations due to JEC uncertainty.
+     * Numbers of events written by the background thread, taken by the calling thread, and
+     * released by it. An event is placed into the buffer with index given by the counter modulo
+     * the number of buffers.
      */
-    std::vector<Jet> jets, jetsJECUp, jetsJECDown;
+    unsigned long nProduced, nTaken, nReleased;
+    
+    /// Indicates that the background thread has no more events to deliver
+    bool producerFinished;
+    
+    /// Requests the background thread to stop
+    bool stopReadAhead;
+    
+    /// Exception thrown in the background thread
+    std::exception_ptr readAheadError;
+    
+    /// Background thread that reads events ahead
+    std::thread readAheadThread;
+    
+    /// Mutex to protect the counters and flags above
+    std::mutex readAheadMutex;
+    
+    /// Condition variable to signal changes in the state of the ring
+    std::condition_variable readAheadCondition;
+    
+    /// Batch of events returned by ReadNextBatch
+    EventBatch batch;
+    
+    /// Buffer to store order of objects in pt when a batch is filled
+    std::vector<unsigned> batchOrder;
     
     /**
-     * \brief METs in the current event
+     * \brief Current event
      * 
-     * Nominal value and systematical variations due to JEC uncertainty.
+     * Points to directEvent or to one of the read-ahead buffers.
      */
-    MET met, metJECUp, metJECDown;
+    Event *curEvent;
+    
+    /// Cached weights of the current event for all variations, indexed as in GetSystIndex
+    std::vector<double> cachedWeights;
     
-    /// Total weight of the event
-    double weight;
+    /**
+     * \brief Values of the event counter at the time the cached weights were computed
+     * 
+     * A cached weight is up-to-date if the stored value equals the current value of the counter.
+     */
+    std::vector<unsigned long> cachedWeightStamps;
     
-    /// Indicates if the weight is up-to-date and should not be recalculated
-    bool weightCached;
+    /// Counter incremented whenever the current event changes
+    unsigned long eventCounter;
     
     /**
      * \brief Flag showing if the reweighting for b-tagging should be applied
@@ -200,24 +733,22 @@ private:
      */
     bool applyBTagReweighting;
     
+    /// Output file for a skim; null if no skim is being produced
+    TFile *skimFile;
+    
+    /// Skimmed copy of the current tree
+    std::unique_ptr<TTree> skimTree;
     
-    // Buffers to read the trees
-    Int_t lepSize;
-    Float_t lepPt[maxSize], lepEta[maxSize], lepPhi[maxSize], lepIso[maxSize];
-    Int_t lepFlavour[maxSize];
+    /// Indicates if components of the event weight are written into the skimmed trees
+    bool skimWeightComponents;
     
-    Int_t jetSize;
-    Float_t jetPt[maxSize], jetEta[maxSize], jetPhi[maxSize], jetBTag[maxSize];
-    Int_t jetFlavour[maxSize];
+    /// Buffers to write components of the event weight into the skimmed trees
+    std::vector<double> skimBTagWeights, skimJetBTagWeights;
     
-    Int_t jetJECUpSize;
-    Float_t jetJECUpPt[maxSize], jetJECUpEta[maxSize], jetJECUpPhi[maxSize], jetJECUpBTag[maxSize];
-    Int_t jetJECUpFlavour[maxSize];
     
-    Int_t jetJECDownSize;
-    Float_t jetJECDownPt[maxSize], jetJECDownEta[maxSize], jetJECDownPhi[maxSize],
-     jetJECDownBTag[maxSize];
-    Int_t jetJECDownFlavour[maxSize];
+    // Buffers to read the trees. Properties of leptons and jets are read directly into the
+    //collections of directEvent
+    Int_t lepSize, jetSize, jetJECUpSize, jetJECDownSize;
     
     Float_t metPt, metPhi;
     Float_t metJECUpPt, metJECUpPhi;
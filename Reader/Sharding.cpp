@@ -0,0 +1,92 @@
+#include <Sharding.hpp>
+
+#include <stdexcept>
+#include <memory>
+#include <algorithm>
+
+
+using namespace std;
+
+
+/**
+ * \brief Reads a tree with the given name from the file
+ * 
+ * Throws an exception if the tree does not exist.
+ */
+static unique_ptr<TTree> GetTree(TFile &srcFile, string const &name)
+{
+    unique_ptr<TTree> tree(dynamic_cast<TTree *>(srcFile.Get(name.c_str())));
+    
+    if (not tree)
+        throw runtime_error(string("Cannot find tree \"") + name + "\" in file \"" +
+         srcFile.GetTitle() + "\".");
+    
+    return tree;
+}
+
+
+vector<unsigned long> GetClusterBoundaries(TTree &tree)
+{
+    vector<unsigned long> boundaries;
+    Long64_t const nEntries = tree.GetEntries();
+    
+    auto clusterIt = tree.GetClusterIterator(0);
+    Long64_t clusterStart;
+    
+    while ((clusterStart = clusterIt()) < nEntries)
+        boundaries.push_back(clusterStart);
+    
+    boundaries.push_back(nEntries);
+    
+    return boundaries;
+}
+
+
+unsigned long CountEntries(TFile &srcFile, list<string> const &treeNames)
+{
+    unsigned long nEntries = 0;
+    
+    for (auto const &name: treeNames)
+        nEntries += GetTree(srcFile, name)->GetEntries();
+    
+    return nEntries;
+}
+
+
+vector<EntryRange> SplitIntoShards(TFile &srcFile, list<string> const &treeNames,
+ unsigned nShards)
+{
+    // Collect boundaries of clusters in all trees, expressed in global indices of entries
+    vector<unsigned long> boundaries{0};
+    unsigned long offset = 0;
+    
+    for (auto const &name: treeNames)
+    {
+        auto const tree = GetTree(srcFile, name);
+        
+        for (auto const &b: GetClusterBoundaries(*tree))
+            if (offset + b > boundaries.back())
+                boundaries.push_back(offset + b);
+        
+        offset += tree->GetEntries();
+    }
+    
+    
+    // Place the boundary of each shard at the first cluster boundary that is not below the ideal
+    //position
+    vector<EntryRange> shards;
+    unsigned long const nEntries = boundaries.back();
+    unsigned long begin = 0;
+    
+    for (unsigned i = 1; i <= nShards; ++i)
+    {
+        unsigned long const target = (i == nShards) ? nEntries :
+         (unsigned long long)(nEntries) * i / nShards;
+        unsigned long const end = *lower_bound(boundaries.begin(), boundaries.end(), target);
+        
+        shards.push_back({begin, end});
+        begin = end;
+    }
+    
+    return shards;
+}
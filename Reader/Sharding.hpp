@@ -0,0 +1,56 @@
+#pragma once
+
+#include <TFile.h>
+#include <TTree.h>
+
+#include <string>
+#include <vector>
+#include <list>
+
+
+/**
+ * \struct EntryRange
+ * \brief A half-open range of entries [begin, end)
+ * 
+ * Depending on the context, indices refer to entries of a single tree or to global indices of
+ * entries in a list of trees, which are numbered as if the trees were concatenated.
+ */
+struct EntryRange
+{
+    /// Index of the first entry in the range
+    unsigned long begin;
+    
+    /// Index of the entry following the last one in the range
+    unsigned long end;
+};
+
+
+/**
+ * \brief Returns indices of entries that start clusters in the given tree
+ * 
+ * The last element of the returned vector is the total number of entries in the tree. Thus, the
+ * vector describes all clusters, with cluster i spanning entries [v[i], v[i + 1]).
+ */
+std::vector<unsigned long> GetClusterBoundaries(TTree &tree);
+
+
+/**
+ * \brief Returns the total number of entries in the given trees
+ * 
+ * Throws an exception if a tree does not exist.
+ */
+unsigned long CountEntries(TFile &srcFile, std::list<std::string> const &treeNames);
+
+
+/**
+ * \brief Splits entries of the given trees into shards aligned to cluster boundaries
+ * 
+ * The trees are considered as if they were concatenated, and the returned ranges are expressed in
+ * global indices of entries, as expected by the method Reader::SetEntryRange. Boundaries of the
+ * shards coincide with boundaries of clusters in the trees, so that no two shards need to read the
+ * same basket. The shards have approximately equal numbers of entries, and together they cover all
+ * entries. Some shards can be empty if there are fewer clusters than shards. Throws an exception
+ * if a tree does not exist.
+ */
+std::vector<EntryRange> SplitIntoShards(TFile &srcFile, std::list<std::string> const &treeNames,
+ unsigned nShards);
@@ -0,0 +1,90 @@
+#include <Systematics.hpp>
+
+
+using namespace std;
+
+
+bool IsKinematic(SystType type)
+{
+    return (type == SystType::JEC);
+}
+
+
+vector<SystVariation> const &GetAllSystVariations()
+{
+    static vector<SystVariation> const variations{
+        {SystType::Nominal, SystDirection::Up},
+        {SystType::JEC, SystDirection::Up}, {SystType::JEC, SystDirection::Down},
+        {SystType::BTagPurityHF, SystDirection::Up}, {SystType::BTagPurityHF, SystDirection::Down},
+        {SystType::BTagPurityLF, SystDirection::Up}, {SystType::BTagPurityLF, SystDirection::Down},
+        {SystType::BTagStatHF1, SystDirection::Up}, {SystType::BTagStatHF1, SystDirection::Down},
+        {SystType::BTagStatHF2, SystDirection::Up}, {SystType::BTagStatHF2, SystDirection::Down},
+        {SystType::BTagStatLF1, SystDirection::Up}, {SystType::BTagStatLF1, SystDirection::Down},
+        {SystType::BTagStatLF2, SystDirection::Up}, {SystType::BTagStatLF2, SystDirection::Down},
+        {SystType::BTagCharmUnc1, SystDirection::Up},
+        {SystType::BTagCharmUnc1, SystDirection::Down},
+        {SystType::BTagCharmUnc2, SystDirection::Up},
+        {SystType::BTagCharmUnc2, SystDirection::Down}
+    };
+    
+    return variations;
+}
+
+
+unsigned GetSystIndex(SystVariation const &variation)
+{
+    if (variation.type == SystType::Nominal)
+        return 0;
+    
+    return 2 * (unsigned(variation.type) - 1) + 1 + unsigned(variation.direction);
+}
+
+
+string GetSystName(SystVariation const &variation)
+{
+    string name;
+    
+    switch (variation.type)
+    {
+        case SystType::Nominal:
+            return "Nominal";
+        
+        case SystType::JEC:
+            name = "JEC";
+            break;
+        
+        case SystType::BTagPurityHF:
+            name = "BTagPurityHF";
+            break;
+        
+        case SystType::BTagPurityLF:
+            name = "BTagPurityLF";
+            break;
+        
+        case SystType::BTagStatHF1:
+            name = "BTagStatHF1";
+            break;
+        
+        case SystType::BTagStatHF2:
+            name = "BTagStatHF2";
+            break;
+        
+        case SystType::BTagStatLF1:
+            name = "BTagStatLF1";
+            break;
+        
+        case SystType::BTagStatLF2:
+            name = "BTagStatLF2";
+            break;
+        
+        case SystType::BTagCharmUnc1:
+            name = "BTagCharmUnc1";
+            break;
+        
+        case SystType::BTagCharmUnc2:
+            name = "BTagCharmUnc2";
+            break;
+    }
+    
+    return name + ((variation.direction == SystDirection::Up) ? "Up" : "Down");
+}
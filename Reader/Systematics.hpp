@@ -1,5 +1,9 @@
 #pragma once
 
+#include <string>
+#include <vector>
+
+
 /**
  * \brief Supported sources of systematical variations
  * 
@@ -27,3 +31,53 @@ enum class SystDirection
     Up,
     Down
 };
+
+
+/**
+ * \struct SystVariation
+ * \brief A systematical variation described by its type and direction
+ * 
+ * For the type Nominal only the direction Up is used.
+ */
+struct SystVariation
+{
+    /// Source of the variation
+    SystType type;
+    
+    /// Direction of the variation
+    SystDirection direction;
+};
+
+
+/**
+ * \brief Checks if the given source of systematics alters kinematics of reconstructed objects
+ * 
+ * Sources for which the function returns false affect the event weight only.
+ */
+bool IsKinematic(SystType type);
+
+
+/**
+ * \brief Returns all supported systematical variations
+ * 
+ * The nominal configuration comes first, and it is followed by the Up and Down variations for
+ * each source in the order of the enumeration SystType.
+ */
+std::vector<SystVariation> const &GetAllSystVariations();
+
+
+/**
+ * \brief Returns the index of the given variation in the list returned by GetAllSystVariations
+ * 
+ * For the type Nominal the direction is ignored.
+ */
+unsigned GetSystIndex(SystVariation const &variation);
+
+
+/**
+ * \brief Returns a short name of the given variation
+ * 
+ * The name is composed of names of the type and the direction, e.g. "JECUp". The nominal
+ * configuration is called "Nominal".
+ */
+std::string GetSystName(SystVariation const &variation);
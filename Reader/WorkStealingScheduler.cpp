@@ -0,0 +1,114 @@
+#include <WorkStealingScheduler.hpp>
+
+#include <thread>
+#include <exception>
+
+
+using namespace std;
+
+
+WorkStealingScheduler::WorkStealingScheduler(unsigned nWorkers_):
+    nWorkers((nWorkers_ > 0) ? nWorkers_ : 1), aborted(false)
+{
+    for (unsigned i = 0; i < nWorkers; ++i)
+        queues.emplace_back(new Queue);
+}
+
+
+void WorkStealingScheduler::AddTask(Task const &task)
+{
+    pendingTasks.push_back(task);
+}
+
+
+unsigned WorkStealingScheduler::GetNumWorkers() const noexcept
+{
+    return nWorkers;
+}
+
+
+void WorkStealingScheduler::Run()
+{
+    // Split the tasks into contiguous blocks of nearly equal size, one per worker
+    for (unsigned i = 0; i < pendingTasks.size(); ++i)
+        queues[(unsigned long)(i) * nWorkers / pendingTasks.size()]->tasks.push_back(
+         move(pendingTasks[i]));
+    
+    pendingTasks.clear();
+    aborted = false;
+    
+    
+    // Run the workers. Exceptions are caught in each thread and rethrown afterwards
+    vector<exception_ptr> errors(nWorkers);
+    vector<thread> threads;
+    
+    for (unsigned i = 0; i < nWorkers; ++i)
+        threads.emplace_back([this, i, &errors]()
+        {
+            try
+            {
+                Work(i);
+            }
+            catch (...)
+            {
+                errors[i] = current_exception();
+                aborted = true;
+            }
+        });
+    
+    for (auto &t: threads)
+        t.join();
+    
+    
+    // Drop tasks that have not been executed because of an error
+    for (auto &q: queues)
+        q->tasks.clear();
+    
+    for (auto const &e: errors)
+        if (e)
+            rethrow_exception(e);
+}
+
+
+void WorkStealingScheduler::Work(unsigned workerIndex)
+{
+    Task task;
+    
+    while (not aborted and FindTask(workerIndex, task))
+        task(workerIndex);
+}
+
+
+bool WorkStealingScheduler::FindTask(unsigned workerIndex, Task &task)
+{
+    // Try the own queue first
+    {
+        Queue &q = *queues[workerIndex];
+        lock_guard<mutex> lock(q.mutex);
+        
+        if (not q.tasks.empty())
+        {
+            task = move(q.tasks.front());
+            q.tasks.pop_front();
+            return true;
+        }
+    }
+    
+    
+    // Steal a task from the back of a queue of another worker. Since no tasks are added during the
+    //execution, the search can stop as soon as all queues have been found empty
+    for (unsigned i = 1; i < nWorkers; ++i)
+    {
+        Queue &q = *queues[(workerIndex + i) % nWorkers];
+        lock_guard<mutex> lock(q.mutex);
+        
+        if (not q.tasks.empty())
+        {
+            task = move(q.tasks.back());
+            q.tasks.pop_back();
+            return true;
+        }
+    }
+    
+    return false;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <atomic>
+
+
+/**
+ * \class WorkStealingScheduler
+ * \brief Executes a set of independent tasks in several threads with work stealing
+ * 
+ * Tasks are first added to the scheduler and then executed with the method Run. At the start of
+ * the execution, the tasks are split into contiguous blocks, one per worker thread, preserving the
+ * order in which they were added. Each worker takes tasks from the front of its own block. When it
+ * runs out of tasks, it steals them from the back of blocks of other workers. Thus, tasks added
+ * one after another (e.g. consecutive ranges of entries in a tree) tend to be processed by the same
+ * worker, while no worker stays idle as long as there are tasks left.
+ */
+class WorkStealingScheduler
+{
+public:
+    /**
+     * \brief Type of a task
+     * 
+     * The task is given the index of the worker that executes it, which can be used to access
+     * per-worker resources without synchronisation.
+     */
+    typedef std::function<void(unsigned workerIndex)> Task;
+    
+public:
+    /// Constructor from the number of worker threads
+    WorkStealingScheduler(unsigned nWorkers);
+    
+public:
+    /// Adds a new task
+    void AddTask(Task const &task);
+    
+    /// Returns the number of worker threads
+    unsigned GetNumWorkers() const noexcept;
+    
+    /**
+     * \brief Executes all tasks that have been added and waits for them to finish
+     * 
+     * If a task throws an exception, the remaining tasks are not started, and the exception is
+     * rethrown from this method once all workers have stopped. The list of tasks is cleared.
+     */
+    void Run();
+    
+private:
+    /// Tasks assigned to a single worker
+    struct Queue
+    {
+        /// Mutex to protect the tasks
+        std::mutex mutex;
+        
+        /// Tasks to be executed
+        std::deque<Task> tasks;
+    };
+    
+private:
+    /// Main loop of a worker thread
+    void Work(unsigned workerIndex);
+    
+    /**
+     * \brief Finds the next task for the given worker
+     * 
+     * Returns false if there are no tasks left in any queue.
+     */
+    bool FindTask(unsigned workerIndex, Task &task);
+    
+private:
+    /// Number of worker threads
+    unsigned nWorkers;
+    
+    /// Tasks that have been added but not yet assigned to workers
+    std::vector<Task> pendingTasks;
+    
+    /// Queues of tasks, one per worker
+    std::vector<std::unique_ptr<Queue>> queues;
+    
+    /// Flag set when a task throws an exception
+    std::atomic<bool> aborted;
+};
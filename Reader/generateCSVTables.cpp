@@ -0,0 +1,129 @@
+#include <TFile.h>
+#include <TH1.h>
+#include <TKey.h>
+#include <TList.h>
+
+#include <string>
+#include <set>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <limits>
+#include <memory>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+
+
+using namespace std;
+
+
+/**
+ * \brief Converts data files with weights for CSV reweighting into a C++ header
+ * 
+ * The program is executed at build time with the following arguments:
+ *   generateCSVTables outputFile.hpp dataFile1.root [dataFile2.root ...]
+ * It reads all one-dimensional histograms with uniform binning from the data files and writes
+ * their content as constexpr arrays described by objects of type CSVReweighter::EmbeddedHistogram.
+ * The header is included by CSVReweighter.cpp, and thus the default constructor of CSVReweighter
+ * needs not read any files. The histograms are identified by names of the data files (without
+ * directories) and their own names.
+ */
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        cerr << "Usage: " << argv[0] << " outputFile.hpp dataFile.root [dataFile.root ...]\n";
+        return EXIT_FAILURE;
+    }
+    
+    
+    // The content of the histograms is accumulated in a buffer, so that no partially written
+    //header is left behind if an error occurs
+    ostringstream arrays, index;
+    arrays << setprecision(numeric_limits<double>::max_digits10);
+    index << setprecision(numeric_limits<double>::max_digits10);
+    unsigned nHists = 0;
+    
+    for (int iArg = 2; iArg < argc; ++iArg)
+    {
+        string const filePath(argv[iArg]);
+        string const fileName(filePath.substr(filePath.find_last_of('/') + 1));
+        unique_ptr<TFile> srcFile(TFile::Open(filePath.c_str()));
+        
+        if (not srcFile or srcFile->IsZombie())
+            throw runtime_error(string("Data file \"") + filePath +
+             "\" does not exist or is corrupted.");
+        
+        
+        // The list of keys includes all cycles of each object, starting from the latest one. Only
+        //the latest cycle is considered
+        set<string> visitedNames;
+        TIter next(srcFile->GetListOfKeys());
+        
+        while (TKey *key = dynamic_cast<TKey *>(next()))
+        {
+            string const name(key->GetName());
+            
+            if (not visitedNames.insert(name).second)
+                continue;
+            
+            unique_ptr<TObject> obj(key->ReadObj());
+            TH1 *hist = dynamic_cast<TH1 *>(obj.get());
+            
+            if (not hist or hist->GetDimension() != 1)
+                continue;
+            
+            hist->SetDirectory(nullptr);
+            
+            
+            // Write the content of the histogram, including the under- and overflow bins
+            TAxis const *axis = hist->GetXaxis();
+            
+            if (axis->IsVariableBinSize())
+                throw runtime_error(string("Histogram \"") + name + "\" in data file \"" +
+                 filePath + "\" has a non-uniform binning.");
+            
+            int const nBins = axis->GetNbins();
+            arrays << "constexpr double csvEmbeddedContent" << nHists << "[] = {";
+            
+            for (int bin = 0; bin < nBins + 2; ++bin)
+            {
+                double const content = hist->GetBinContent(bin);
+                
+                if (not isfinite(content))
+                    throw runtime_error(string("Histogram \"") + name + "\" in data file \"" +
+                     filePath + "\" contains a non-finite value.");
+                
+                arrays << ((bin % 4 == 0) ? "\n " : " ") << content <<
+                 ((bin < nBins + 1) ? "," : "");
+            }
+            
+            arrays << "};\n\n";
+            
+            index << " {\"" << fileName << "\", \"" << name << "\", " << nBins << ", " <<
+             axis->GetXmin() << ", " << axis->GetXmax() << ", csvEmbeddedContent" << nHists <<
+             "},\n";
+            ++nHists;
+        }
+    }
+    
+    if (nHists == 0)
+        throw runtime_error("No histograms found in the data files.");
+    
+    
+    // Write the header
+    ofstream outFile(argv[1]);
+    
+    if (not outFile)
+        throw runtime_error(string("Cannot create file \"") + argv[1] + "\".");
+    
+    outFile << "// Generated by generateCSVTables. Do not edit.\n\n#pragma once\n\n" <<
+     "#include <CSVReweighter.hpp>\n\n\n" << arrays.str() << "\n" <<
+     "constexpr CSVReweighter::EmbeddedHistogram csvEmbeddedHistograms[] = {\n" << index.str() <<
+     "};\n";
+    
+    
+    return EXIT_SUCCESS;
+}
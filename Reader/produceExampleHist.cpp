@@ -1,11 +1,19 @@
 #include <Reader.hpp>
+#include <DerivedQuantities.hpp>
+#include <WorkStealingScheduler.hpp>
 
 #include <TFile.h>
 #include <TH1D.h>
+#include <TThread.h>
 
 #include <list>
+#include <vector>
+#include <string>
 #include <iostream>
 #include <memory>
+#include <thread>
+#include <cstdlib>
+#include <stdexcept>
 
 
 using namespace std;
@@ -47,16 +55,303 @@ Group::Group(string const &name_, initializer_list<string> const &treeNames_,
 {}
 
 
-int main()
+/**
+ * \struct QuantityIndices
+ * \brief Indices of quantities used in the event selection
+ * 
+ * Quantities are requested by their indices in per-event code, which avoids look-ups by name.
+ */
+struct QuantityIndices
+{
+    /// Flag indicating that the event contains a single good lepton
+    unsigned passLepton;
+    
+    /// Number of good jets
+    unsigned nGoodJets;
+    
+    /// Transverse mass of the W boson
+    unsigned MtW;
+};
+
+
+/**
+ * \brief Declares quantities used in the event selection and returns their indices
+ * 
+ * Each quantity is computed at most once per event and per systematical variation that can affect
+ * it, no matter how many times it is requested.
+ */
+QuantityIndices DefineQuantities(DerivedQuantities &quantities)
+{
+    QuantityIndices indices;
+    
+    
+    // Event should contain exactly one charged lepton (muon in this case), which should have
+    //sufficient transverse momentum and should not be too forward. This does not depend on JEC
+    indices.passLepton = quantities.Define("passLepton", {}, SystDependence::None,
+     [](Reader &reader, DerivedQuantities &) -> double
+    {
+        auto const &leptons = reader.GetLeptons();
+        
+        if (leptons.size() != 1)
+            return 0.;
+        
+        auto const l = leptons.front();
+        return (l.Pt() >= 26. and fabs(l.Eta()) <= 2.1);
+    });
+    
+    
+    // Number of central jets with pt > 30 GeV. The loop runs over contiguous arrays of jet
+    //properties and contains no branches, which allows the compiler to vectorise it
+    indices.nGoodJets = quantities.Define("nGoodJets", {}, SystDependence::Kinematic,
+     [](Reader &reader, DerivedQuantities &) -> double
+    {
+        auto const &jets = reader.GetJets();
+        float const *jetPt = jets.PtArray();
+        float const *jetEta = jets.EtaArray();
+        unsigned const nJets = jets.size();
+        unsigned nGoodJets = 0;
+        
+        for (unsigned i = 0; i < nJets; ++i)
+            nGoodJets += (jetPt[i] >= 30.f) & (fabs(jetEta[i]) < 2.4f);
+        
+        return nGoodJets;
+    });
+    
+    
+    // The variable of interest. It is only meaningful for events with a single lepton, and zero
+    //is returned for other events
+    unsigned const passLepton = indices.passLepton;
+    indices.MtW = quantities.Define("MtW", {"passLepton"}, SystDependence::Kinematic,
+     [passLepton](Reader &reader, DerivedQuantities &q) -> double
+    {
+        if (q.Get(passLepton) == 0.)
+            return 0.;
+        
+        auto const l = reader.GetLeptons().front();
+        MET const &met = reader.GetMET();
+        
+        return sqrt(pow(l.Pt() + met.Pt(), 2) -
+         pow(l.Px() + met.Px(), 2) - pow(l.Py() + met.Py(), 2));
+    });
+    
+    
+    return indices;
+}
+
+
+/**
+ * \brief Applies the event selection and calculates MtW
+ * 
+ * Returns false if the current event does not pass the selection. Otherwise returns true and sets
+ * the value of MtW. The current systematical variation of the reader is taken into account.
+ */
+bool SelectEvent(DerivedQuantities &quantities, QuantityIndices const &indices, double &MtW)
+{
+    if (quantities.Get(indices.passLepton) == 0. or quantities.Get(indices.nGoodJets) < 4)
+        return false;
+    
+    MtW = quantities.Get(indices.MtW);
+    return true;
+}
+
+
+/**
+ * \struct WorkerState
+ * \brief Resources owned by a single worker thread
+ * 
+ * Nothing in this structure is shared between threads.
+ */
+struct WorkerState
+{
+    /// Copy of the source file opened by the worker
+    shared_ptr<TFile> srcFile;
+    
+    /// Index of the group read by the current reader
+    unsigned iGroup;
+    
+    /// Reader for the group being processed, created on demand
+    unique_ptr<Reader> reader;
+    
+    /// Derived quantities computed from the reader
+    unique_ptr<DerivedQuantities> quantities;
+    
+    /// Indices of the derived quantities
+    QuantityIndices indices;
+    
+    /// Input statistics of all readers used by the worker, for each group
+    vector<vector<IOStats>> ioStats;
+};
+
+
+/**
+ * \brief Deletes the reader of the given worker, keeping its input statistics
+ * 
+ * Does nothing if the worker has no reader.
+ */
+void ReleaseReader(WorkerState &worker)
+{
+    if (not worker.reader)
+        return;
+    
+    auto const &stats = worker.reader->GetIOStats();
+    auto &groupStats = worker.ioStats[worker.iGroup];
+    groupStats.insert(groupStats.end(), stats.begin(), stats.end());
+    
+    worker.quantities.reset();
+    worker.reader.reset();
+}
+
+
+/**
+ * \struct Chunk
+ * \brief A range of entries of a group processed as a single task, together with its results
+ * 
+ * The histograms are filled by the worker that processes the chunk and are only accessed by it
+ * until all tasks have finished.
+ */
+struct Chunk
+{
+    /// Index of the group
+    unsigned iGroup;
+    
+    /// Range of entries in the trees of the group
+    EntryRange range;
+    
+    /// Histograms filled with events from this chunk only
+    vector<TH1D> hists;
+};
+
+
+/**
+ * \brief Creates histograms to be filled for the given group
+ * 
+ * One histogram is created for each systematical variation. The nominal histogram is named after
+ * the group, and names of other ones include also the name of the variation. For data only the
+ * nominal histogram is needed.
+ */
+vector<TH1D> BookHists(Group const &group)
+{
+    auto const &variations = GetAllSystVariations();
+    unsigned const nVariations = (group.isMC) ? variations.size() : 1;
+    vector<TH1D> hists;
+    hists.reserve(nVariations);
+    
+    for (unsigned i = 0; i < nVariations; ++i)
+    {
+        string const name((i == 0) ? group.name : group.name + "_" + GetSystName(variations[i]));
+        hists.emplace_back(name.c_str(), "Transverse W mass;M_{T}(W), GeV;Events", 60, 0., 120.);
+        
+        // The histogram will be filled with weighted events. Indicate that the weight should be
+        //accounted in bin uncertainties
+        hists.back().Sumw2();
+    }
+    
+    return hists;
+}
+
+
+/**
+ * \brief Configures the given reader for this example
+ * 
+ * Requests only the needed collections and sets a preselection.
+ */
+void ConfigureReader(Reader &reader)
+{
+    // Only a few collections are used in this example. Do not read anything else
+    reader.SetCollections({Collection::Leptons, Collection::Jets, Collection::JetsJEC,
+     Collection::MET, Collection::METJEC, Collection::Weight});
+    
+    
+    // The selection requires exactly one lepton and at least four jets, in the nominal
+    //configuration or with JEC variations. Skip events that cannot satisfy it without reading
+    //properties of the objects
+    reader.SetPreselection([](Multiplicities const &m){return (m.nLeptons == 1 and
+     (m.nJets >= 4 or m.nJetsJECUp >= 4 or m.nJetsJECDown >= 4));});
+}
+
+
+/**
+ * \brief Reads all remaining events with the given reader and fills the histograms
+ * 
+ * The histograms must have been created with the function BookHists, and the indices must have
+ * been returned by DefineQuantities for the given quantities.
+ */
+void FillHists(Reader &reader, DerivedQuantities &quantities, QuantityIndices const &indices,
+ vector<TH1D> &hists)
+{
+    // Loop over all events. Each event is read only once. The selection is evaluated for the
+    //nominal configuration and for each variation that alters kinematics, while variations that
+    //affect only the weight reuse the nominal result
+    vector<double> weights;
+    
+    while (reader.ReadNextEvent())
+    {
+        // Weights for all variations are evaluated in one go
+        reader.GetWeights(weights);
+        
+        reader.ForEachKinematicSystematics([&quantities, &indices, &hists, &weights](
+         SystVariation const &, vector<unsigned> const &weightVariations)
+        {
+            double MtW;
+            
+            if (not SelectEvent(quantities, indices, MtW))
+                return;
+            
+            
+            // Fill the histograms. Note that simulated events are weighted
+            for (unsigned const &i: weightVariations)
+                hists[i].Fill(MtW, weights[i]);
+        });
+    }
+}
+
+
+/**
+ * \brief Produces histograms of MtW for all groups of processes
+ * 
+ * Arguments are the ones given to the program. Returns the exit code of the program. Errors are
+ * reported with exceptions, including those thrown by tasks in the worker threads.
+ */
+int ProduceHists(int argc, char **argv)
 {
     // ROOT manages memory in a very funny way. By default, it will assign every histogram to the
     //file accessed lastly. This behaviour is not desirable and is disabled by the following command
     TH1::AddDirectory(kFALSE);
     
     
-    // Open the source ROOT file
-    shared_ptr<TFile> srcFile(TFile::Open("/data/shared/Long_Exercise_TTbar/mujets_v3.root"));
-    //shared_ptr<TFile> srcFile(TFile::Open("/afs/cern.ch/work/j/jandrea/public/proof_merged.root"));
+    // Trees are processed in parallel. The number of threads can be given as the only argument of
+    //the program. By default, as many threads as there are cores are used
+    unsigned const maxThreads = 256;
+    unsigned nThreads = thread::hardware_concurrency();
+    
+    if (argc > 1)
+    {
+        // Out-of-range values are clamped by strtol and then rejected as too large or too small
+        char *end;
+        long const n = strtol(argv[1], &end, 10);
+        
+        if (argc > 2 or end == argv[1] or *end != '\0' or n <= 0 or n > long(maxThreads))
+        {
+            cerr << "Usage: " << argv[0] << " [nThreads]\n" <<
+             "The number of threads must be an integer between 1 and " << maxThreads << ".\n";
+            return EXIT_FAILURE;
+        }
+        
+        nThreads = n;
+    }
+    
+    // The number of cores might be unknown
+    if (nThreads == 0)
+        nThreads = 1;
+    
+    
+    // ROOT must be told about multithreading before any thread is started
+    TThread::Initialize();
+    
+    
+    // Path to the source ROOT file. Each thread will open it independently
+    string const srcFileName("/data/shared/Long_Exercise_TTbar/mujets_v3.root");
+    //string const srcFileName("/afs/cern.ch/work/j/jandrea/public/proof_merged.root");
     //^ There are copies at CMS DAS machines and AFS
     
     
@@ -64,7 +359,7 @@ int main()
     //several groups, and an independent histogram will be produced for all processes in each group.
     //Define here what processes (what trees) are grouped together and assign some meaningful name
     //to each group
-    list<Group> groups;
+    vector<Group> groups;
     groups.emplace_back(Group("Data", {"SingleMuRun2012A", "SingleMuRun2012B", "SingleMuRun2012C",
      "SingleMuRun2012D"}, false));
     groups.emplace_back(Group("ttbar", {"TTJets"}));
@@ -79,77 +374,137 @@ int main()
      "QCD_Pt-170to300_MuEnrichedPt5", "QCD_Pt-300to470_MuEnrichedPt5"}));
     
     
-    // Create an output file to store the histograms that will be created
-    TFile outFile("MtW.root", "recreate");
-    
+    // Split the trees of each group into chunks of consecutive entries. The chunks are aligned to
+    //cluster boundaries, so that no two chunks need to decompress the same basket. Their size is
+    //chosen such that there are many more chunks than threads, which allows to balance the load
+    //even though the trees differ in size by orders of magnitude
+    WorkStealingScheduler scheduler(nThreads);
+    vector<WorkerState> workers(nThreads);
+    vector<Chunk> chunks;
     
-    // Loop over the groups
-    for (auto const &group: groups)
     {
-        // A bit of verbosity
-        cout << "Processing group \"" << group.name << "\"..." << endl;
-        
-        
-        // Create a reader for the current group
-        Reader reader(srcFile, group.treeNames, group.isMC);
-        
+        shared_ptr<TFile> srcFile(TFile::Open(srcFileName.c_str()));
         
-        // Create a histogram to be filled. It is named after the group
-        TH1D histMtW(group.name.c_str(), "Transverse W mass;M_{T}(W), GeV;Events", 60, 0., 120.);
+        if (not srcFile or srcFile->IsZombie())
+            throw runtime_error("The source file does not exist or is corrupted.");
         
+        vector<unsigned long> groupSizes;
+        unsigned long totalSize = 0;
         
-        // The histogram will be filled with weighted events. Indicate that the weight should be
-        //accounted in bin uncertainties
-        histMtW.Sumw2();
+        for (auto const &group: groups)
+        {
+            groupSizes.push_back(CountEntries(*srcFile, group.treeNames));
+            totalSize += groupSizes.back();
+        }
         
+        unsigned long const chunkSize = totalSize / (16 * nThreads) + 1;
         
-        // Loop over all events in the current group of processes
-        while (reader.ReadNextEvent())
+        for (unsigned iGroup = 0; iGroup < groups.size(); ++iGroup)
         {
-            // Perform some event selection
-            // Event should contain exactly one charged lepton (muon in this case)
-            if (reader.GetLeptons().size() != 1)
-                continue;
+            unsigned const nChunks = groupSizes[iGroup] / chunkSize + 1;
             
+            for (auto const &range: SplitIntoShards(*srcFile, groups[iGroup].treeNames, nChunks))
+                if (range.begin != range.end)
+                    chunks.push_back({iGroup, range, {}});
+        }
+    }
+    
+    
+    // Each chunk is processed by a reader that belongs to the worker thread. A worker keeps a
+    //single reader at a time, so that memory used by caches does not grow with the number of
+    //groups. Since consecutive chunks are assigned to the same worker, the reader is only replaced
+    //when the worker moves on to another group. Results of every chunk are kept in separate
+    //histograms, so that they can be merged in a fixed order
+    for (auto &chunk: chunks)
+    {
+        scheduler.AddTask([&groups, &workers, &srcFileName, &chunk](unsigned iWorker)
+        {
+            Group const &group = groups[chunk.iGroup];
+            WorkerState &worker = workers[iWorker];
             
-            // The muon should have sufficient transverse momentum and should not be too forward
-            Lepton const &l = reader.GetLeptons().front();
-            
-            if (l.Pt() < 26. or fabs(l.Eta()) > 2.1)
-                continue;
-            
-            
-            // Require that there are at least four central jets with pt > 30 GeV
-            auto const &jets = reader.GetJets();
-            unsigned nGoodJets = 0;
-            
-            for (auto const &j: jets)
+            if (not worker.srcFile)
             {
-                if (j.Pt() < 30.)  // jets are ordered in pt
-                    break;
+                shared_ptr<TFile> srcFile(TFile::Open(srcFileName.c_str()));
+                
+                if (not srcFile or srcFile->IsZombie())
+                    throw runtime_error("Worker " + to_string(iWorker) + " cannot open the "
+                     "source file \"" + srcFileName + "\".");
                 
-                if (fabs(j.Eta()) < 2.4)
-                    ++nGoodJets;
+                worker.srcFile = srcFile;
+                worker.ioStats.resize(groups.size());
             }
             
-            if (nGoodJets < 4)
-                continue;
+            if (worker.reader and worker.iGroup != chunk.iGroup)
+                ReleaseReader(worker);
             
+            if (not worker.reader)
+            {
+                worker.iGroup = chunk.iGroup;
+                worker.reader.reset(new Reader(worker.srcFile, group.treeNames, group.isMC));
+                ConfigureReader(*worker.reader);
+                worker.quantities.reset(new DerivedQuantities(*worker.reader));
+                worker.indices = DefineQuantities(*worker.quantities);
+            }
             
-            // Calculate the variable of interest
-            MET const &met = reader.GetMET();
-            double const MtW = sqrt(pow(l.Pt() + met.Pt(), 2) -
-             pow(l.P4().Px() + met.P4().Px(), 2) - pow(l.P4().Py() + met.P4().Py(), 2));
+            chunk.hists = BookHists(group);
+            worker.reader->SetEntryRange(chunk.range);
+            FillHists(*worker.reader, *worker.quantities, worker.indices, chunk.hists);
+        });
+    }
+    
+    
+    // Process the chunks. Each thread opens its own copy of the source file, and it uses its own
+    //reader and histograms. Thus, the threads share no ROOT objects. Input statistics of the
+    //readers are collected once all chunks have been processed
+    cout << "Processing " << groups.size() << " groups in " << nThreads << " threads..." << endl;
+    scheduler.Run();
+    
+    for (auto &worker: workers)
+        ReleaseReader(worker);
+    
+    
+    // Create an output file to store the histograms that will be created
+    TFile outFile("MtW.root", "recreate");
+    
+    
+    // Merge histograms from all chunks of each group and save them in the output file. Chunks are
+    //merged in the order in which they were created, so the result does not depend on how they
+    //were assigned to threads and is reproducible bit by bit
+    for (unsigned iGroup = 0; iGroup < groups.size(); ++iGroup)
+    {
+        vector<TH1D> hists(BookHists(groups[iGroup]));
+        Long64_t readCalls = 0, bytesRead = 0;
+        
+        for (auto const &chunk: chunks)
+        {
+            if (chunk.iGroup != iGroup)
+                continue;
             
+            for (unsigned i = 0; i < hists.size(); ++i)
+                hists[i].Add(&chunk.hists[i]);
+        }
+        
+        for (auto const &worker: workers)
+        {
+            if (not worker.srcFile)
+                continue;
             
-            // Fill the histogram. Note that simulated events are weighted
-            histMtW.Fill(MtW, reader.GetWeight());
+            for (auto const &s: worker.ioStats[iGroup])
+            {
+                readCalls += s.readCalls;
+                bytesRead += s.bytesRead;
+            }
         }
         
         
-        // The histogram for the current group has been filled. Save it in the output file
+        // Report how much data have been read from the source file for the group
+        cout << "Group \"" << groups[iGroup].name << "\": " << readCalls << " read calls, " <<
+         bytesRead / 1048576. << " MiB read\n";
+        
         outFile.cd();
-        histMtW.Write();
+        
+        for (auto &h: hists)
+            h.Write();
     }
     
     
@@ -158,3 +513,17 @@ int main()
     
     return EXIT_SUCCESS;
 }
+
+
+int main(int argc, char **argv)
+{
+    try
+    {
+        return ProduceHists(argc, argv);
+    }
+    catch (exception const &e)
+    {
+        cerr << "Error: " << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+}
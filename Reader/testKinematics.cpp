@@ -0,0 +1,285 @@
+#include <Kinematics.hpp>
+
+#include <TLorentzVector.h>
+
+#include <vector>
+#include <random>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+
+using namespace std;
+
+
+/// Relative tolerance for the Cartesian components
+double const convertTolerance = 1e-6;
+
+/// Tolerance for distances in the (eta, phi) space, relative to max(1, deltaR)
+double const deltaRTolerance = 1e-5;
+
+
+/**
+ * \brief Compares a value computed by a kernel with the reference
+ * 
+ * The difference is measured in units of the given scale. If it exceeds the tolerance, a message
+ * is printed and false is returned.
+ */
+bool CheckClose(char const *what, unsigned index, double value, double reference, double scale,
+ double tolerance)
+{
+    if (fabs(value - reference) <= tolerance * scale)
+        return true;
+    
+    cout << "  " << what << "[" << index << "] = " << value << ", expected " << reference <<
+     " (scale " << scale << ")\n";
+    return false;
+}
+
+
+/**
+ * \brief Builds inputs for the conversion
+ * 
+ * Includes a grid of edge cases, which covers phi close to +-pi, tiny and large |eta| (including
+ * values outside the range supported by the kernel), and zero masses, followed by random inputs.
+ * The number of random inputs is chosen not to be a multiple of the vector width.
+ */
+void BuildConvertInputs(vector<float> &pt, vector<float> &eta, vector<float> &phi,
+ vector<float> &mass)
+{
+    float const pi = M_PI;
+    
+    for (float const p: {0.5f, 30.f, 1000.f})
+        for (float const h: {0.f, 1e-7f, -1e-7f, 10.f, -10.f, 19.9f, -19.9f, 20.f, -20.f, 25.f,
+         -25.f})
+            for (float const f: {0.f, pi, -pi, nextafter(pi, 0.f), nextafter(-pi, 0.f),
+             float(M_PI - 1e-6), float(-M_PI + 1e-6), float(M_PI / 2), float(-M_PI / 2)})
+                for (float const m: {0.f, 0.1f, 125.f})
+                {
+                    pt.push_back(p);
+                    eta.push_back(h);
+                    phi.push_back(f);
+                    mass.push_back(m);
+                }
+    
+    
+    mt19937 generator(4357);
+    uniform_real_distribution<float> ptDistr(1.f, 1000.f), etaDistr(-5.f, 5.f),
+     phiDistr(-pi, pi), massDistr(0.f, 200.f);
+    
+    for (unsigned i = 0; i < 10001; ++i)
+    {
+        pt.push_back(ptDistr(generator));
+        eta.push_back(etaDistr(generator));
+        phi.push_back(phiDistr(generator));
+        mass.push_back(massDistr(generator));
+    }
+}
+
+
+/**
+ * \brief Checks ConvertToCartesian against TLorentzVector::SetPtEtaPhiM
+ * 
+ * The conversion is checked with the given masses and with a null array of masses, in which case
+ * the reference is computed for zero masses. The transverse components are compared in units of
+ * pt, the longitudinal component and energy in units of energy. Returns the number of failures.
+ */
+unsigned TestConvert()
+{
+    vector<float> pt, eta, phi, mass;
+    BuildConvertInputs(pt, eta, phi, mass);
+    unsigned const n = pt.size();
+    
+    vector<float> px(n), py(n), pz(n), e(n);
+    unsigned nFailures = 0;
+    
+    for (bool const massless: {false, true})
+    {
+        ConvertToCartesian(n, pt.data(), eta.data(), phi.data(), (massless) ? nullptr : mass.data(),
+         px.data(), py.data(), pz.data(), e.data());
+        
+        for (unsigned i = 0; i < n; ++i)
+        {
+            // The kernel clips pseudorapidities
+            TLorentzVector ref;
+            ref.SetPtEtaPhiM(pt[i], max(-20.f, min(eta[i], 20.f)), phi[i],
+             (massless) ? 0. : mass[i]);
+            
+            bool const pass =
+             CheckClose("px", i, px[i], ref.Px(), pt[i], convertTolerance) &
+             CheckClose("py", i, py[i], ref.Py(), pt[i], convertTolerance) &
+             CheckClose("pz", i, pz[i], ref.Pz(), ref.E(), convertTolerance) &
+             CheckClose("e", i, e[i], ref.E(), ref.E(), convertTolerance);
+            
+            if (not pass)
+            {
+                cout << "    for pt = " << pt[i] << ", eta = " << eta[i] << ", phi = " << phi[i] <<
+                 ", mass = " << ((massless) ? 0.f : mass[i]) << "\n";
+                ++nFailures;
+            }
+        }
+    }
+    
+    return nFailures;
+}
+
+
+/**
+ * \brief Builds two collections of objects for the computation of distances
+ * 
+ * Edge cases include pairs of objects on the opposite sides of the boundary phi = +-pi, pairs of
+ * coincident objects, and pairs with a difference in phi close to pi. Random objects follow.
+ */
+void BuildDeltaRInputs(vector<float> &eta1, vector<float> &phi1, vector<float> &eta2,
+ vector<float> &phi2)
+{
+    float const pi = M_PI;
+    
+    for (float const f: {pi, -pi, float(M_PI - 1e-3), float(-M_PI + 1e-3), 0.f, float(M_PI / 2)})
+    {
+        eta1.push_back(0.5f);
+        phi1.push_back(f);
+        eta2.push_back(-0.5f);
+        phi2.push_back(-f);
+    }
+    
+    eta1.push_back(2.f);
+    phi1.push_back(1.f);
+    eta2.push_back(2.f);
+    phi2.push_back(1.f);
+    
+    
+    mt19937 generator(7919);
+    uniform_real_distribution<float> etaDistr(-5.f, 5.f), phiDistr(-pi, pi);
+    
+    for (unsigned i = 0; i < 37; ++i)
+    {
+        eta1.push_back(etaDistr(generator));
+        phi1.push_back(phiDistr(generator));
+    }
+    
+    for (unsigned i = 0; i < 53; ++i)
+    {
+        eta2.push_back(etaDistr(generator));
+        phi2.push_back(phiDistr(generator));
+    }
+}
+
+
+/// Computes the reference distance with TLorentzVector::DeltaR
+double ReferenceDeltaR(float eta1, float phi1, float eta2, float phi2)
+{
+    TLorentzVector p1, p2;
+    p1.SetPtEtaPhiM(1., eta1, phi1, 0.);
+    p2.SetPtEtaPhiM(1., eta2, phi2, 0.);
+    return p1.DeltaR(p2);
+}
+
+
+/**
+ * \brief Checks ComputeDeltaRMatrix and FindNearest against TLorentzVector::DeltaR
+ * 
+ * The nearest neighbour found by FindNearest is accepted if its reference distance agrees with the
+ * smallest reference distance within the tolerance, which allows for near-ties. The case of an
+ * empty second collection is checked as well. Returns the number of failures.
+ */
+unsigned TestDeltaR()
+{
+    vector<float> eta1, phi1, eta2, phi2;
+    BuildDeltaRInputs(eta1, phi1, eta2, phi2);
+    unsigned const n1 = eta1.size(), n2 = eta2.size();
+    
+    vector<double> ref(n1 * n2);
+    
+    for (unsigned i = 0; i < n1; ++i)
+        for (unsigned j = 0; j < n2; ++j)
+            ref[i * n2 + j] = ReferenceDeltaR(eta1[i], phi1[i], eta2[j], phi2[j]);
+    
+    unsigned nFailures = 0;
+    
+    
+    // Matrix of distances
+    vector<float> deltaR(n1 * n2);
+    ComputeDeltaRMatrix(n1, eta1.data(), phi1.data(), n2, eta2.data(), phi2.data(), deltaR.data());
+    
+    for (unsigned k = 0; k < n1 * n2; ++k)
+        if (not CheckClose("deltaR", k, deltaR[k], ref[k], max(1., ref[k]), deltaRTolerance))
+            ++nFailures;
+    
+    
+    // Nearest neighbours
+    vector<int> indices(n1);
+    vector<float> nearestDeltaR(n1);
+    FindNearest(n1, eta1.data(), phi1.data(), n2, eta2.data(), phi2.data(), indices.data(),
+     nearestDeltaR.data());
+    
+    for (unsigned i = 0; i < n1; ++i)
+    {
+        double const minDeltaR = *min_element(ref.begin() + i * n2, ref.begin() + (i + 1) * n2);
+        double const scale = max(1., minDeltaR);
+        
+        if (indices[i] < 0 or unsigned(indices[i]) >= n2)
+        {
+            cout << "  index[" << i << "] = " << indices[i] << " is out of range\n";
+            ++nFailures;
+        }
+        else if (not CheckClose("nearest", i, ref[i * n2 + indices[i]], minDeltaR, scale,
+         deltaRTolerance) or
+         not CheckClose("nearestDeltaR", i, nearestDeltaR[i], minDeltaR, scale, deltaRTolerance))
+            ++nFailures;
+    }
+    
+    
+    // Empty second collection
+    FindNearest(n1, eta1.data(), phi1.data(), 0, nullptr, nullptr, indices.data(),
+     nearestDeltaR.data());
+    
+    for (unsigned i = 0; i < n1; ++i)
+    {
+        if (indices[i] != -1 or nearestDeltaR[i] != -1.f)
+        {
+            cout << "  empty collection: index[" << i << "] = " << indices[i] <<
+             ", deltaR[" << i << "] = " << nearestDeltaR[i] << ", expected -1\n";
+            ++nFailures;
+        }
+    }
+    
+    return nFailures;
+}
+
+
+/**
+ * \brief Checks the kinematic kernels against TLorentzVector
+ * 
+ * Each build of the kernels supported by the processor is tested in turn. Builds that are not
+ * included or not supported are reported as skipped. The program returns a non-zero code if any
+ * check fails.
+ */
+int main()
+{
+    cout.precision(9);
+    unsigned nFailures = 0;
+    
+    for (char const *build: {"avx2", "sse4.1", "default"})
+    {
+        if (not SetKinematicsKernel(build))
+        {
+            cout << "Build \"" << build << "\": skipped\n";
+            continue;
+        }
+        
+        cout << "Build \"" << build << "\":\n";
+        unsigned const nConvertFailures = TestConvert();
+        cout << " ConvertToCartesian: " << ((nConvertFailures == 0) ? "passed" : "FAILED") << "\n";
+        nFailures += nConvertFailures;
+        
+        unsigned const nDeltaRFailures = TestDeltaR();
+        cout << " ComputeDeltaRMatrix and FindNearest: " <<
+         ((nDeltaRFailures == 0) ? "passed" : "FAILED") << "\n";
+        nFailures += nDeltaRFailures;
+    }
+    
+    
+    return (nFailures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}